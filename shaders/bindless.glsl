@@ -0,0 +1,48 @@
+// global set of src/vk_bindless.h, every resource is indexed through push
+// constants, declarations of one binding alias each other
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (set = 0, binding = 0, rgba16f) uniform image2D images_2d[];
+
+layout (set = 0, binding = 0, r16f) uniform image2D images_2d_r16f[];
+
+layout (set = 0, binding = 0, r8) uniform image2D images_2d_r8[];
+
+layout (set = 0, binding = 0, rgba16f) uniform image3D images_3d[];
+
+layout (set = 0, binding = 0, r16f) uniform image3D images_3d_r16f[];
+
+layout (set = 0, binding = 0, r8) uniform image3D images_3d_r8[];
+
+layout (set = 0, binding = 1) uniform sampler2D textures_2d[];
+
+layout (set = 0, binding = 1) uniform sampler3D textures_3d[];
+
+// the uniform ring among them, read at push_uniform offsets
+layout (set = 0, binding = 2, std430) readonly buffer BUFFERS {
+    vec4 data[];
+} buffers[];
+
+// the same buffers as counters to add to
+layout (set = 0, binding = 2, std430) buffer COUNTERS {
+    uint data[];
+} counters[];
+
+struct camera_t {
+    vec3 pos;
+    float fov;
+    vec3 dir;
+    float width;
+    vec3 left;
+    float height;
+};
+
+camera_t load_camera(uint buffer, uint offset)
+{
+    uint i = offset / 16;
+    vec4 a = buffers[buffer].data[i];
+    vec4 b = buffers[buffer].data[i + 1];
+    vec4 c = buffers[buffer].data[i + 2];
+    return camera_t(a.xyz, a.w, b.xyz, b.w, c.xyz, c.w);
+}
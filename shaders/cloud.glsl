@@ -0,0 +1,140 @@
+// cloud_data of src/vk_engine.h and the density model, shared by the march
+// and the passes bounding it and baking its light. include after
+// bindless.glsl
+
+struct cloud_t {
+    float type;
+    float freq;
+    float ambient;
+    float sigma_a;
+    float sigma_s;
+    float step;
+    float pad;
+    float cutoff;
+    vec3 sun_color;
+    float density;
+    vec3 sky_color;
+    vec3 sun_dir;
+};
+
+cloud_t load_cloud(uint buffer, uint offset)
+{
+    uint i = offset / 16;
+    vec4 a = buffers[buffer].data[i];
+    vec4 b = buffers[buffer].data[i + 1];
+    vec4 c = buffers[buffer].data[i + 2];
+    vec4 d = buffers[buffer].data[i + 3];
+    vec4 e = buffers[buffer].data[i + 4];
+    return cloud_t(a.x, a.y, a.z, a.w, b.x, b.y, b.z, b.w, c.xyz, c.w, d.xyz,
+                   e.xyz);
+}
+
+// loaded from the ring at the start of main
+cloud_t cloud;
+
+// the shell between two spheres around the origin, above y = 0
+const float inner_radius = 150.f;
+const float thickness = 800.f;
+
+// occupancy grid over the shell, level l has grid_cells >> l cells and
+// starts at z = grid_offsets[l] of one image
+const vec3 grid_min = vec3(-960.f, 0.f, -960.f);
+const vec3 grid_extent = vec3(1920.f, 960.f, 1920.f);
+const ivec3 grid_cells = ivec3(64, 32, 64);
+const int grid_levels = 3;
+const int grid_offsets[3] = int[](0, 64, 96);
+
+// the optical depth towards the sun is baked over the same box, integrated
+// over light_distance * cloud.step from each texel
+const float light_distance = 54.f;
+
+float remap(float value, float old_min, float old_max, float new_min, float new_max)
+{
+    return clamp(new_min + ((value - old_min) / (old_max - old_min))
+            * (new_max - new_min), new_min, new_max);
+}
+
+ivec2 weather_texel(vec3 p)
+{
+    return ivec2(p.xz * .3f + vec2(256.f));
+}
+
+// world units a weather texel spans at mip 0, 1 / cloud.freq for cloudtex
+const float weather_texel_size = 1.f / .3f;
+
+// the march samples no coarser than max_lod, a filtered fetch there reads
+// mip 0 texels up to lod_margin away from its point
+const float max_lod = 2.f;
+const int lod_margin = 8;
+
+// mip level whose texels match a footprint of length world units
+float lod(float length, float texel)
+{
+    return clamp(log2(length / texel), 0.f, max_lod);
+}
+
+// the three worley octaves of a texel of the reference layout in one, the
+// compact detail volume stores this sum
+float worley(vec4 d)
+{
+    return .625f * d.y + .25f * d.z + .125f * d.w;
+}
+
+// 1 in the body of the cloud, fading out towards its base and top
+float height_type(float h)
+{
+    float lowerupperlimit = remap(cloud.type, 0.f, 1.f, .11f, .25f);
+    float upperlowerlimit = remap(cloud.type, 0.f, 1.f, .13f, .75f);
+    float upperupperlimit = remap(cloud.type, 0.f, 1.f, .14f, .89f);
+
+    float type = 1.f;
+    type = h < lowerupperlimit ? smoothstep(.1f, lowerupperlimit, h) : type;
+    type = h > upperlowerlimit ?
+        smoothstep(upperupperlimit, upperlowerlimit, h) : type;
+
+    return type;
+}
+
+// largest height_type over [h0, h1], it rises to 1 and falls again
+float max_height_type(float h0, float h1)
+{
+    float lowerupperlimit = remap(cloud.type, 0.f, 1.f, .11f, .25f);
+    float upperlowerlimit = remap(cloud.type, 0.f, 1.f, .13f, .75f);
+
+    if (h1 >= lowerupperlimit && h0 <= upperlowerlimit)
+        return 1.f;
+
+    return max(height_type(h0), height_type(h1));
+}
+
+// density before the height gradient, increasing in every argument, so the
+// maxima of a region bound the density anywhere in it
+float shape(float noise, float worley, float c, float type)
+{
+    float d = remap(noise, 1.f - c, 1.f, 0.f, 1.f);
+    d = remap(d, 1.f - cloud.density, 1.f, 0.f, 1.f);
+    d = remap(d, -worley, 1.f, 0.f, 1.f);
+    d = remap(d, 1.f - type, 1.f, 0.f, 1.f);
+    return remap(d, cloud.cutoff, 1.f, 0.f, 1.f);
+}
+
+// density of the 8 bit shape and detail volumes at p, h the height in the
+// shell and c the weather there. both are sampled trilinear and tiling at
+// lod, the detail volume has texels as large as the shape volume and a
+// quarter its size
+float sample_density(uint shape_volume, uint detail_volume, vec3 p, float h,
+                     float c, float lod)
+{
+    vec3 uv = p * cloud.freq / 128.f;
+    float s = textureLod(textures_3d[shape_volume], uv, lod).x;
+    float w = textureLod(textures_3d[detail_volume], uv * 4.f, lod).x;
+    return shape(s, w, c, height_type(h)) * h;
+}
+
+// the weather map at p, clamped to 0 outside
+float sample_weather(uint weather, vec3 p, float lod)
+{
+    vec2 size = vec2(textureSize(textures_2d[weather], 0));
+    return textureLod(textures_2d[weather], (p.xz * .3f + 256.f) / size,
+                      lod).x;
+}
@@ -0,0 +1,38 @@
+# cmake -DOUTPUT=file.cpp -DSPIRV="a.spv|b.spv" -P embed.cmake
+#
+# writes every spir-v binary as a byte array into one source file, listed in
+# embedded_shaders under the name of its glsl source (see src/vk_shader.h)
+
+string(REPLACE "|" ";" SPIRV "${SPIRV}")
+
+# sixteen bytes a line
+string(REPEAT "0x[0-9a-f][0-9a-f]," 16 LINE)
+
+set(ARRAYS "")
+set(TABLE "")
+
+foreach(FILE ${SPIRV})
+    get_filename_component(NAME ${FILE} NAME)
+    string(REGEX REPLACE "\\.spv$" "" NAME ${NAME})
+    string(MAKE_C_IDENTIFIER "spirv_${NAME}" IDENTIFIER)
+
+    file(READ ${FILE} HEX HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+    string(REGEX REPLACE "(${LINE})" "\\1\n    " BYTES "${BYTES}")
+    string(REGEX REPLACE "\n    $" "" BYTES "${BYTES}")
+
+    string(APPEND ARRAYS
+        "alignas(uint32_t) static const unsigned char ${IDENTIFIER}[] = {\n"
+        "    ${BYTES}\n};\n\n")
+    string(APPEND TABLE
+        "    {\"${NAME}\", ${IDENTIFIER}, sizeof(${IDENTIFIER})},\n")
+endforeach()
+
+set(SOURCE "// generated by shaders/embed.cmake, do not edit\n\n")
+string(APPEND SOURCE "#include <cstdint>\n\n#include \"vk_shader.h\"\n\n")
+string(APPEND SOURCE "${ARRAYS}")
+string(APPEND SOURCE "const embedded_shader embedded_shaders[] = {\n")
+string(APPEND SOURCE "${TABLE}    {nullptr, nullptr, 0},\n};\n")
+
+# left untouched when no shader changed, nothing recompiles then
+file(CONFIGURE OUTPUT ${OUTPUT} CONTENT "${SOURCE}" @ONLY)
@@ -1,6 +1,12 @@
 #include "vk_engine.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
 
 #include <SDL3/SDL.h>
 #include <imgui.h>
@@ -8,12 +14,87 @@
 #include "vk_boiler.h"
 #include "vk_cmd.h"
 #include "vk_comp.h"
+#include "vk_noise.h"
 #include "vk_pipeline.h"
 #include "vk_type.h"
 
 int main(int argc, char *argv[])
 {
     vk_engine engine = {};
+
+    /* vk_engine [--headless] [--frames N] [--res WxH] [--out file.ppm]
+                 [--frames-in-flight N] [--no-async-compute]
+                 [--temporal 1|4|16] [--record-threads N]
+                 [--bench-recording] [--memory-json file.json]
+                 [--shader-dir dir] [--quality low|medium|high|ultra]
+                 [--noise compact|reference|split] [--fixed-steps] */
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0)
+            engine._headless = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            engine._headless_frames = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--res") == 0 && i + 1 < argc) {
+            /* 16384 is the largest 2d image desktop devices allow, a
+               negative size wraps far past it */
+            const char *res = argv[++i];
+            uint32_t width, height;
+            if (std::sscanf(res, "%ux%u", &width, &height) == 2 && width > 0 &&
+                height > 0 && width <= 16384 && height <= 16384) {
+                engine._window_extent = {width, height};
+                engine._resolution = {width, height};
+            } else
+                std::cerr << "unknown resolution: " << res << std::endl;
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            engine._headless_output = argv[++i];
+        else if (std::strcmp(argv[i], "--frames-in-flight") == 0 &&
+                 i + 1 < argc)
+            engine._scheduler.frame_overlap =
+                std::clamp<uint32_t>(std::strtoul(argv[++i], nullptr, 10), 1,
+                                     MAX_FRAME_OVERLAP);
+        else if (std::strcmp(argv[i], "--no-async-compute") == 0)
+            engine._async_compute = false;
+        else if (std::strcmp(argv[i], "--temporal") == 0 && i + 1 < argc) {
+            /* 1, 4 or 16, one in N pixels marched per frame */
+            uint32_t n = std::strtoul(argv[++i], nullptr, 10);
+            engine._temporal_data.block = n >= 16 ? 4 : n >= 4 ? 2 : 1;
+        } else if (std::strcmp(argv[i], "--record-threads") == 0 &&
+                   i + 1 < argc)
+            engine._record_threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--bench-recording") == 0) {
+            engine._headless = true;
+            engine._bench_recording = true;
+        } else if (std::strcmp(argv[i], "--memory-json") == 0 && i + 1 < argc)
+            engine._memory_output = argv[++i];
+        else if (std::strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc)
+            shader_cache.dir = argv[++i];
+        else if (std::strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            uint32_t q = 0;
+            while (q < CLOUD_QUALITY_COUNT &&
+                   std::strcmp(name, CLOUD_QUALITY_NAMES[q]) != 0)
+                ++q;
+
+            if (q < CLOUD_QUALITY_COUNT)
+                engine._cloud_quality = q;
+            else
+                std::cerr << "unknown quality: " << name << std::endl;
+        } else if (std::strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            uint32_t n = 0;
+            while (n < NOISE_MODE_COUNT &&
+                   std::strcmp(name, NOISE_MODE_NAMES[n]) != 0)
+                ++n;
+
+            if (n < NOISE_MODE_COUNT)
+                engine._noise_mode = n;
+            else
+                std::cerr << "unknown noise: " << name << std::endl;
+        } else if (std::strcmp(argv[i], "--fixed-steps") == 0)
+            engine._adaptive_steps = false;
+        else
+            std::cerr << "unknown argument: " << argv[i] << std::endl;
+    }
+
     engine.init();
     engine.run();
     engine.cleanup();
@@ -30,172 +111,499 @@ int main(int argc, char *argv[])
         allocator.create_buffer(..., buffer_name);
         allocator.load_img(img_name, ...);
 
-    comp_allocator has static class member for storing buffers and images
-    in unordered_map with their name as key, it is common to share resources
-    within multiple shaders. By default, _target, "target" is the framebuffer
-    we draw to.
-
-        std::vector<descriptor> descriptors = {
-            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, img_name},
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, buffer_name},
-        };
+    comp_allocator keeps buffers and images in registries looked up by the
+    hash of their name, it is common to share resources within multiple
+    shaders. create_* returns a typed handle, an unknown name or a handle to
+    a removed resource aborts instead of reading the wrong slot. By default,
+    _target, "target" is the framebuffer we draw to.
 
-        cs compute_shader_example(allocator,
-                                descriptors,
-                                "../shaders/example.spv",
-                                _min_buffer_alignment);
+    Every storage image, sampled image and storage buffer is also written
+    into one global bindless set as it is created. Shaders include
+    bindless.glsl and take the indices, storage_index(name), and the ring
+    offsets returned by push_uniform through push constants, so a compute
+    shader needs no descriptor set of its own.
 
-    Descriptors binding is done with vector of "descriptor" which is std::pair
-   of <VkDescriptorType, std::string>, provided the name and arguments, create
-   class cs. Then start building pipeline using info from struct cs and
-   comp_allocator.
+        cs compute_shader_example(&allocator, "example.comp");
 
         PipelineBuilder pb = {};
         pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
             VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_example.module));
 
-        pb.build_comp(...);
+        pb.build_comp(_device, &compute_shader_example);
 
-    Finally, add draw commands. At this point, you have mutiple options, you
-   have to run cc_init(...) the first time. After that, you could push_back(...)
-   to have it executed in the main loop, or call comp_immediate_submit(...) to
-   execute immediately, the latter one is ofter used for preparing texture or
-   data used later.
+    Finally, add draw commands. Either add a pass to _graph to have it
+   executed in the main loop, or call immediate_draw(...) to execute
+   immediately, the latter one is ofter used for preparing texture or data used
+   later. Passes declare every image and buffer they touch, the graph places
+   the barriers and layout transitions between them.
 
-        compute_shader_example.draw = [=](VkCommandBuffer cbuffer, cs *cs) {
+        std::vector<graph_use> uses = {
+            storage_read(buffer_name),
+            storage_write(img_name),
+        };
+
+        _graph.add_pass("example", uses, [=](VkCommandBuffer cbuffer) {
             vkCmdBindPipeline(...);
-            vkCmdBindDescriptorSets(...);
+            vkCmdPushConstants(...);
             vkCmdDispatch(...);
-        };
+        });
 
-        cs::cc_init(_comp_index, _device);
-        cs::push_back(compute_shader_example);
-        cs::comp_immediate_submit(_device, _queue,
-   &compute_shader_example);
+    The graph binds the global set once per command buffer. A pass may be
+    recorded on any worker thread, or several times, so its callback only
+    reads engine state. Per-frame decisions go in update_comp instead.
+
+    An image that is rewritten every frame before it is read can be created
+    with create_transient_img instead. _graph.compile(), once every pass is
+    added, backs all transients with one allocation, and those whose passes
+    do not overlap share memory.
 
 */
 
 void vk_engine::comp_init()
 {
-    _comp_allocator.device = _device;
-    _comp_allocator.vma_allocator = _allocator;
-    _comp_allocator.init();
-
-    _comp_allocator.create_buffer(pad_uniform_buffer_size(sizeof(camera_data)),
-                                  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                                  "camera");
-
-    _comp_allocator.load_img("target", _target);
+    _comp_allocator.load_img("target", _target, VK_IMAGE_USAGE_STORAGE_BIT);
 
+    downsample_init();
     cloudtex_init();
+    cloudtex_max_init();
     weather_init();
+    occupancy_init();
+    light_init();
+    blue_noise_init();
     cloud_init();
+
+    _graph.compile();
+}
+
+void vk_engine::downsample_init()
+{
+    cs downsample(&_comp_allocator, "downsample.comp");
+
+    PipelineBuilder pb = {};
+    pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
+        VK_SHADER_STAGE_COMPUTE_BIT, downsample.module));
+
+    pb.build_comp(_device, &downsample);
+    _downsample_pipeline = downsample.pipeline;
+}
+
+void vk_engine::downsample(VkCommandBuffer cbuffer, img_handle id)
+{
+    /* looked up now, a transient only has its views once placed */
+    allocated_img &img = _comp_allocator.imgs[id];
+
+    vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      _downsample_pipeline);
+
+    for (uint32_t mip = 1; mip < img.mip_levels; ++mip) {
+        downsample_push push = {};
+        push.src = _comp_allocator.mip_storage_index(id, mip - 1);
+        push.dst = _comp_allocator.mip_storage_index(id, mip);
+        push.format = DOWNSAMPLE_RGBA16F_3D;
+        if (img.format == VK_FORMAT_R8_UNORM)
+            push.format =
+                img.extent.depth > 1 ? DOWNSAMPLE_R8_3D : DOWNSAMPLE_R8_2D;
+
+        vkCmdPushConstants(cbuffer, _comp_allocator.pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(downsample_push), &push);
+
+        uint32_t width = std::max(img.extent.width >> mip, 1u);
+        uint32_t height = std::max(img.extent.height >> mip, 1u);
+        uint32_t depth = std::max(img.extent.depth >> mip, 1u);
+        vkCmdDispatch(cbuffer, (width + 7) / 8, (height + 7) / 8, depth);
+
+        /* the next level reads this one */
+        vk_cmd::vk_img_layout_transition(cbuffer, img.img,
+                                         VK_IMAGE_LAYOUT_GENERAL,
+                                         VK_IMAGE_LAYOUT_GENERAL,
+                                         _comp_fam_index);
+    }
 }
 
 void vk_engine::cloudtex_init()
 {
     uint32_t cloudtex_size = 128;
 
-    uint32_t id = _comp_allocator.create_img(
-        VK_FORMAT_R16G16B16A16_SFLOAT,
+    uint32_t detail_size = 32;
+    VkImageUsageFlags usage =
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    /* sampled trilinear and tiling by cloud.comp, down to 1 texel. the shape
+       volume and the detail volume are one byte a texel */
+    std::vector<img_handle> ids;
+    ids.push_back(_comp_allocator.create_img(
+        VK_FORMAT_R8_UNORM,
         VkExtent3D{cloudtex_size, cloudtex_size, cloudtex_size},
-        VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT, 0, "cloudtex");
+        VK_IMAGE_ASPECT_COLOR_BIT, usage, 0, "cloudtex", 8,
+        _comp_allocator.repeat_sampler));
 
-    _comp_allocator.create_buffer(pad_uniform_buffer_size(sizeof(float)),
-                                  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                                  "size");
+    ids.push_back(_comp_allocator.create_img(
+        VK_FORMAT_R8_UNORM, VkExtent3D{detail_size, detail_size, detail_size},
+        VK_IMAGE_ASPECT_COLOR_BIT, usage, 0, "cloudtex_detail", 6,
+        _comp_allocator.repeat_sampler));
 
-    /* match set binding */
-    std::vector<descriptor> descriptors = {
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, "cloudtex"},
-    };
+    /* the 16 MB layout before them, only to compare against */
+    _noise_reference = _noise_mode != 0;
+    if (_noise_reference)
+        ids.push_back(_comp_allocator.create_img(
+            VK_FORMAT_R16G16B16A16_SFLOAT,
+            VkExtent3D{cloudtex_size, cloudtex_size, cloudtex_size},
+            VK_IMAGE_ASPECT_COLOR_BIT, usage, 0, "cloudtex_reference", 8,
+            _comp_allocator.repeat_sampler));
 
-    cs cloudtex(&_comp_allocator, descriptors, "../shaders/cloudtex.comp.spv",
-                _min_buffer_alignment);
+    cs cloudtex(&_comp_allocator, "cloudtex.comp");
 
     /* build pipeline */
     PipelineBuilder pb = {};
     pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
         VK_SHADER_STAGE_COMPUTE_BIT, cloudtex.module));
 
-    std::vector<VkPushConstantRange> push_constants = {};
-    pb.build_comp(_device, push_constants, &cloudtex);
+    pb.build_comp(_device, &cloudtex);
+
+    cloudtex_push push = {};
+    push.shape = _comp_allocator.imgs[ids[0]].storage_index;
+    push.detail = _comp_allocator.imgs[ids[1]].storage_index;
+    push.reference = _noise_reference
+                         ? _comp_allocator.imgs[ids[2]].storage_index
+                         : BINDLESS_NONE;
 
     immediate_draw(
-        [&, cloudtex, cloudtex_size, id](VkCommandBuffer cbuffer) {
-            vk_cmd::vk_img_layout_transition(
-                cbuffer, _comp_allocator.imgs[id].img,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, _fam_index);
+        [&, cloudtex, cloudtex_size, ids, push](VkCommandBuffer cbuffer) {
+            for (img_handle id : ids)
+                vk_cmd::vk_img_layout_transition(
+                    cbuffer, _comp_allocator.imgs[id].img,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                    _comp_fam_index);
 
             vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
                               cloudtex.pipeline);
 
-            vkCmdBindDescriptorSets(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                                    cloudtex.pipeline_layout, 0, 1,
-                                    &cloudtex.set, 0, nullptr);
+            _comp_allocator.bind(cbuffer);
+            vkCmdPushConstants(cbuffer, cloudtex.pipeline_layout,
+                               VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(cloudtex_push), &push);
 
+            /* the detail volume is written by the first 32^3 invocations */
             vkCmdDispatch(cbuffer, cloudtex_size / 8, cloudtex_size / 8,
                           cloudtex_size / 8);
+
+            for (img_handle id : ids) {
+                vk_cmd::vk_img_layout_transition(
+                    cbuffer, _comp_allocator.imgs[id].img,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                    _comp_fam_index);
+
+                downsample(cbuffer, id);
+            }
         },
-        _queue);
+        _comp_queue);
+
+    /* the first pass reading them waits on these dispatches */
+    _graph.import_img("cloudtex", VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    _graph.import_img("cloudtex_detail", VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    if (_noise_reference)
+        _graph.import_img("cloudtex_reference", VK_IMAGE_LAYOUT_GENERAL,
+                          VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
+
+void vk_engine::cloudtex_max_init()
+{
+    /* every level of the pyramid stacked along z, see cloudtex_max.comp */
+    img_handle id = _comp_allocator.create_img(
+        VK_FORMAT_R16G16B16A16_SFLOAT, VkExtent3D{64, 64, 128},
+        VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT, 0,
+        "cloudtex_max");
+
+    cs cloudtex_max(&_comp_allocator, "cloudtex_max.comp");
+
+    PipelineBuilder pb = {};
+    pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
+        VK_SHADER_STAGE_COMPUTE_BIT, cloudtex_max.module));
+
+    pb.build_comp(_device, &cloudtex_max);
+
+    cloudtex_max_push push = {};
+    push.cloudtex = _comp_allocator.storage_index("cloudtex");
+    push.detail = _comp_allocator.storage_index("cloudtex_detail");
+    push.reference = _noise_reference
+                         ? _comp_allocator.storage_index("cloudtex_reference")
+                         : BINDLESS_NONE;
+    push.target = _comp_allocator.imgs[id].storage_index;
+
+    immediate_draw(
+        [&, cloudtex_max, id, push](VkCommandBuffer cbuffer) {
+            vk_cmd::vk_img_layout_transition(
+                cbuffer, _comp_allocator.imgs[id].img,
+                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                _comp_fam_index);
+
+            vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              cloudtex_max.pipeline);
+            _comp_allocator.bind(cbuffer);
+
+            /* each level reads the one before, 128 texels down to 1 */
+            for (uint32_t level = 1; level <= 7; ++level) {
+                cloudtex_max_push p = push;
+                p.level = level;
+                vkCmdPushConstants(cbuffer, cloudtex_max.pipeline_layout,
+                                   VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   sizeof(cloudtex_max_push), &p);
+
+                uint32_t groups = ((128 >> level) + 3) / 4;
+                vkCmdDispatch(cbuffer, groups, groups, groups);
+
+                vk_cmd::vk_img_layout_transition(
+                    cbuffer, _comp_allocator.imgs[id].img,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                    _comp_fam_index);
+            }
+        },
+        _comp_queue);
+
+    _graph.import_img("cloudtex_max", VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
 }
 
 void vk_engine::weather_init()
 {
     uint32_t weather_size = 512;
 
-    uint32_t id = _comp_allocator.create_img(
-        VK_FORMAT_R16_SFLOAT, VkExtent3D{weather_size, weather_size, 1},
-        VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT, 0, "weather");
+    /* only lives from the weather pass to the cloud pass, which samples it
+       trilinear and reads 0 outside like the imageLoad before it */
+    img_handle id = _comp_allocator.create_transient_img(
+        VK_FORMAT_R8_UNORM, VkExtent3D{weather_size, weather_size, 1},
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, "weather",
+        10, _comp_allocator.border_sampler);
 
-    std::vector<descriptor> descriptors = {
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, "weather"},
-    };
-
-    cs weather(&_comp_allocator, descriptors, "../shaders/weather.comp.spv",
-               _min_buffer_alignment);
+    cs weather(&_comp_allocator, "weather.comp");
 
     PipelineBuilder pb = {};
     pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
         VK_SHADER_STAGE_COMPUTE_BIT, weather.module));
 
-    VkPushConstantRange u_time_pc = {};
-    u_time_pc.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    u_time_pc.offset = 0;
-    u_time_pc.size = sizeof(float);
+    pb.build_comp(_device, &weather);
 
-    std::vector<VkPushConstantRange> push_constants = {u_time_pc};
-    pb.build_comp(_device, push_constants, &weather);
+    uint32_t target = _comp_allocator.storage_index("weather");
 
-    cs_draw.push_back([&, weather, weather_size, id](VkCommandBuffer cbuffer) {
-        vk_cmd::vk_img_layout_transition(cbuffer, _comp_allocator.imgs[id].img,
-                                         VK_IMAGE_LAYOUT_UNDEFINED,
-                                         VK_IMAGE_LAYOUT_GENERAL, _fam_index);
+    /* rewritten from scratch every frame */
+    std::vector<graph_use> uses = {
+        storage_write("weather"),
+    };
 
+    _graph.add_pass("weather", uses, [&, weather, weather_size,
+                                      target](VkCommandBuffer cbuffer) {
         vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
                           weather.pipeline);
 
-        vkCmdBindDescriptorSets(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                                weather.pipeline_layout, 0, 1, &weather.set, 0,
-                                nullptr);
-
-        u_time = SDL_GetTicks() / 10000.f;
+        weather_push push = {u_time, target};
         vkCmdPushConstants(cbuffer, weather.pipeline_layout,
-                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float),
-                           &u_time);
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(weather_push),
+                           &push);
 
         vkCmdDispatch(cbuffer, weather_size / 8, weather_size / 8, 1);
     });
+
+    /* mip 0 of the weather pass down to 1 texel */
+    std::vector<graph_use> mip_uses = {
+        storage_read_write("weather"),
+    };
+
+    _graph.add_pass("weather mips", mip_uses, [&, id](VkCommandBuffer cbuffer) {
+        downsample(cbuffer, id);
+    });
+}
+
+void vk_engine::occupancy_init()
+{
+    _comp_allocator.create_img(VK_FORMAT_R16_SFLOAT, OCCUPANCY_EXTENT,
+                               VK_IMAGE_ASPECT_COLOR_BIT,
+                               VK_IMAGE_USAGE_STORAGE_BIT, 0, "occupancy");
+
+    cs occupancy(&_comp_allocator, "occupancy.comp");
+
+    PipelineBuilder pb = {};
+    pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
+        VK_SHADER_STAGE_COMPUTE_BIT, occupancy.module));
+
+    pb.build_comp(_device, &occupancy);
+
+    occupancy_push indices = {};
+    indices.target = _comp_allocator.storage_index("occupancy");
+    indices.weather = _comp_allocator.storage_index("weather");
+    indices.cloudtex_max = _comp_allocator.storage_index("cloudtex_max");
+    indices.uniforms = _comp_allocator.uniform_index();
+    indices.drift = OCCUPANCY_DRIFT;
+
+    /* the grid outlives the frame, a pass skipping the rebuild keeps it */
+    std::vector<graph_use> uses = {
+        storage_write("occupancy", false),
+        storage_read("weather"),
+        storage_read("cloudtex_max"),
+    };
+
+    _graph.add_pass("occupancy", uses, [&, occupancy,
+                                        indices](VkCommandBuffer cbuffer) {
+        /* see draw_comp */
+        if (!_occupancy_rebuild)
+            return;
+
+        vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          occupancy.pipeline);
+
+        occupancy_push push = indices;
+        push.cloud =
+            _comp_allocator.push_uniform(&_cloud_data, sizeof(cloud_data));
+
+        /* a column of cells per invocation, levels are independent */
+        for (uint32_t level = 0; level < OCCUPANCY_LEVELS; ++level) {
+            push.level = level;
+            vkCmdPushConstants(cbuffer, occupancy.pipeline_layout,
+                               VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(occupancy_push), &push);
+
+            uint32_t columns = OCCUPANCY_EXTENT.width >> level;
+            vkCmdDispatch(cbuffer, (columns + 7) / 8, (columns + 7) / 8, 1);
+        }
+    });
+}
+
+void vk_engine::light_init()
+{
+    /* sampled trilinear by cloud.comp, 0 outside the box */
+    _comp_allocator.create_img(
+        VK_FORMAT_R16_SFLOAT, LIGHT_EXTENT, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0, "light", 1,
+        _comp_allocator.border_sampler);
+
+    cs light(&_comp_allocator, "light.comp");
+
+    PipelineBuilder pb = {};
+    pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
+        VK_SHADER_STAGE_COMPUTE_BIT, light.module));
+
+    pb.build_comp(_device, &light);
+
+    light_push indices = {};
+    indices.target = _comp_allocator.storage_index("light");
+    indices.weather = _comp_allocator.sampled_index("weather");
+    indices.cloudtex = _comp_allocator.sampled_index("cloudtex");
+    indices.detail = _comp_allocator.sampled_index("cloudtex_detail");
+    indices.uniforms = _comp_allocator.uniform_index();
+
+    /* a frame only rewrites some slices, the rest are kept */
+    std::vector<graph_use> uses = {
+        storage_write("light", false),
+        sampled_read("weather"),
+        sampled_read("cloudtex"),
+        sampled_read("cloudtex_detail"),
+    };
+
+    _graph.add_pass("light", uses, [&, light,
+                                    indices](VkCommandBuffer cbuffer) {
+        vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          light.pipeline);
+
+        uint32_t depth = LIGHT_EXTENT.depth / LIGHT_SLICES;
+
+        light_push push = indices;
+        push.first = _light_first * depth;
+        push.steps = CLOUD_QUALITIES[_cloud_quality].light_steps;
+        push.cloud =
+            _comp_allocator.push_uniform(&_cloud_data, sizeof(cloud_data));
+
+        vkCmdPushConstants(cbuffer, light.pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(light_push),
+                           &push);
+
+        vkCmdDispatch(cbuffer, LIGHT_EXTENT.width / 8,
+                      LIGHT_EXTENT.height / 8, _light_count * depth);
+    });
+}
+
+void vk_engine::blue_noise_init()
+{
+    std::vector<uint8_t> texels = blue_noise(BLUE_NOISE_SIZE);
+
+    img_handle id = _comp_allocator.create_img(
+        VK_FORMAT_R8_UNORM, VkExtent3D{BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 1},
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0,
+        "blue_noise");
+
+    /* staged once through a buffer of its own, then freed */
+    allocated_buffer staging;
+    create_buffer(texels.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                  &staging);
+
+    void *data;
+    vmaMapMemory(_allocator, staging.allocation, &data);
+    std::memcpy(data, texels.data(), texels.size());
+    vmaFlushAllocation(_allocator, staging.allocation, 0, VK_WHOLE_SIZE);
+    vmaUnmapMemory(_allocator, staging.allocation);
+
+    VkImage img = _comp_allocator.imgs[id].img;
+
+    immediate_draw(
+        [&](VkCommandBuffer cbuffer) {
+            vk_cmd::vk_img_layout_transition(
+                cbuffer, img, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _comp_fam_index);
+
+            VkBufferImageCopy region = vk_boiler::buffer_img_copy(
+                VkExtent3D{BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 1});
+
+            vkCmdCopyBufferToImage(cbuffer, staging.buffer, img,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                   &region);
+
+            vk_cmd::vk_img_layout_transition(
+                cbuffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_GENERAL, _comp_fam_index);
+        },
+        _comp_queue);
+
+    vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+
+    _graph.import_img("blue_noise", VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+                      VK_ACCESS_2_TRANSFER_WRITE_BIT);
 }
 
 void vk_engine::cloud_init()
 {
-    uint32_t cloud_id = _comp_allocator.create_buffer(
-        pad_uniform_buffer_size(sizeof(cloud_data)),
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, "cloud");
+    /* ping-pong, dynamic resolution only ever uses the top left part */
+    for (const char *name : {"history0", "history1"})
+        _comp_allocator.create_img(
+            VK_FORMAT_R16G16B16A16_SFLOAT,
+            VkExtent3D{_resolution.width, _resolution.height, 1},
+            VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT, 0,
+            res_name::dynamic(name));
+
+    _march_stats_buffer = _comp_allocator.create_buffer(
+        MAX_FRAME_OVERLAP * sizeof(march_stats),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        "march_stats");
+
+    VmaAllocation stats_allocation =
+        _comp_allocator.buffers[_march_stats_buffer].allocation;
+
+    VmaAllocationInfo allocation_info = {};
+    vmaGetAllocationInfo(_comp_allocator.vma_allocator, stats_allocation,
+                         &allocation_info);
+    _march_stats = (march_stats *)allocation_info.pMappedData;
+    std::memset(_march_stats, 0, MAX_FRAME_OVERLAP * sizeof(march_stats));
 
     _cloud_data.type = .6f;
     _cloud_data.freq = .2f;
@@ -203,78 +611,169 @@ void vk_engine::cloud_init()
     _cloud_data.sigma_a = 0.f;
     _cloud_data.sigma_s = .2f;
     _cloud_data.step = 1.3f;
-    _cloud_data.max_steps = 64;
     _cloud_data.cutoff = .5f;
     _cloud_data.density = 1.f;
     _cloud_data.sun_color = glm::vec3(.99f, .36f, .32f);
     _cloud_data.sky_color = glm::vec3(.98f, .83f, .64f);
+    _cloud_data.sun_dir = glm::normalize(glm::vec3(0.f, .6f, 1.f));
 
-    std::vector<descriptor> descriptors = {
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, "target"},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, "cloudtex"},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, "weather"},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, "camera"},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, "cloud"},
-    };
-
-    cs cloud(&_comp_allocator, descriptors, "../shaders/cloud.comp.spv",
-             _min_buffer_alignment);
+    cs cloud(&_comp_allocator, "cloud.comp");
 
     PipelineBuilder pb = {};
     pb._shader_stage_infos.push_back(vk_boiler::shader_stage_create_info(
         VK_SHADER_STAGE_COMPUTE_BIT, cloud.module));
 
-    std::vector<VkPushConstantRange> push_constants = {};
-    pb.build_comp(_device, push_constants, &cloud);
+    VkSpecializationMapEntry entries[] = {
+        {0, offsetof(cloud_quality, max_steps), sizeof(int32_t)},
+        {2, offsetof(cloud_quality, min_transmittance), sizeof(float)},
+        {3, offsetof(cloud_quality, skip), sizeof(float)},
+        {4, offsetof(cloud_quality, phase_lobes), sizeof(int32_t)},
+    };
 
-    uint32_t camera_id = _comp_allocator.get_buffer_id("camera");
+    for (uint32_t i = 0; i < CLOUD_QUALITY_COUNT; ++i) {
+        VkSpecializationInfo specialization = {};
+        specialization.mapEntryCount = sizeof(entries) / sizeof(entries[0]);
+        specialization.pMapEntries = entries;
+        specialization.dataSize = sizeof(cloud_quality);
+        specialization.pData = &CLOUD_QUALITIES[i];
+
+        pb.build_comp(_device, &cloud, &specialization);
+        _cloud_pipelines[i] = cloud.pipeline;
+    }
+
+    /* heap indices never change, the ring offsets are filled per frame */
+    cloud_push indices = {};
+    indices.target = _comp_allocator.storage_index("target");
+    indices.cloudtex = _comp_allocator.sampled_index("cloudtex");
+    indices.weather = _comp_allocator.sampled_index("weather");
+    indices.history0 = _comp_allocator.storage_index("history0");
+    indices.history1 = _comp_allocator.storage_index("history1");
+    indices.occupancy = _comp_allocator.storage_index("occupancy");
+    indices.detail = _comp_allocator.sampled_index("cloudtex_detail");
+    indices.light = _comp_allocator.sampled_index("light");
+    indices.blue_noise = _comp_allocator.storage_index("blue_noise");
+    indices.stats =
+        _comp_allocator.buffers[_march_stats_buffer].storage_index;
+    indices.reference =
+        _noise_reference ? _comp_allocator.sampled_index("cloudtex_reference")
+                         : BINDLESS_NONE;
+    indices.uniforms = _comp_allocator.uniform_index();
+
+    /* uniforms come from the host through the ring and need no barrier, the
+       history images swap roles every frame */
+    std::vector<graph_use> uses = {
+        storage_write("target"),
+        sampled_read("cloudtex"),
+        sampled_read("cloudtex_detail"),
+        sampled_read("weather"),
+        storage_read("occupancy"),
+        sampled_read("light"),
+        storage_read("blue_noise"),
+        storage_read_write("march_stats"),
+        storage_read_write("history0"),
+        storage_read_write("history1"),
+    };
 
-    cs_draw.push_back([&, cloud, camera_id, cloud_id](VkCommandBuffer cbuffer) {
+    if (_noise_reference)
+        uses.push_back(sampled_read("cloudtex_reference"));
+
+    _graph.add_pass("cloud", uses, [&, cloud,
+                                    indices](VkCommandBuffer cbuffer) {
         vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          cloud.pipeline);
-
-        _camera_data.pos = _vk_camera.get_pos();
-        _camera_data.fov = _vk_camera.get_fov();
-        _camera_data.dir = _vk_camera.get_dir();
-        _camera_data.width = _resolution.width;
-        _camera_data.left = _vk_camera.get_left();
-        _camera_data.height = _resolution.height;
-
-        void *data;
-        vmaMapMemory(_allocator, _comp_allocator.buffers[camera_id].allocation,
-                     &data);
-        std::memcpy(data, &_camera_data,
-                    pad_uniform_buffer_size(sizeof(camera_data)));
-        vmaUnmapMemory(_allocator,
-                       _comp_allocator.buffers[camera_id].allocation);
-
-        vmaMapMemory(_allocator, _comp_allocator.buffers[cloud_id].allocation,
-                     &data);
-        std::memcpy(data, &_cloud_data,
-                    pad_uniform_buffer_size(sizeof(cloud_data)));
-        vmaUnmapMemory(_allocator,
-                       _comp_allocator.buffers[cloud_id].allocation);
-
-        std::vector<uint32_t> doffsets = {0, 0};
-        vkCmdBindDescriptorSets(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                                cloud.pipeline_layout, 0, 1, &cloud.set,
-                                doffsets.size(), doffsets.data());
-
-        vkCmdDispatch(cbuffer, _resolution.width / 8, _resolution.height / 8,
-                      1);
+                          _cloud_pipelines[_cloud_quality]);
+
+        /* this frame's region of the uniform ring */
+        cloud_push push = indices;
+        push.temporal = _temporal_data;
+        push.noise = _noise_reference ? _noise_mode : 0;
+        push.stats_slot = _temporal_data.frame % MAX_FRAME_OVERLAP;
+        push.adaptive = _adaptive_steps;
+        push.camera =
+            _comp_allocator.push_uniform(&_camera_data, sizeof(camera_data));
+        push.cloud =
+            _comp_allocator.push_uniform(&_cloud_data, sizeof(cloud_data));
+        push.prev_camera = _comp_allocator.push_uniform(&_prev_camera_data,
+                                                        sizeof(camera_data));
+
+        vkCmdPushConstants(cbuffer, cloud.pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cloud_push),
+                           &push);
+
+        vkCmdDispatch(cbuffer, (_render_extent.width + 7) / 8,
+                      (_render_extent.height + 7) / 8, 1);
     });
 }
 
+void vk_engine::update_comp()
+{
+    /* read by the weather and occupancy passes, fixed 60 hz timestep when
+       headless for reproducible runs */
+    u_time = _headless ? _scheduler.current() / 600.f
+                       : SDL_GetTicks() / 10000.f;
+
+    _camera_data.pos = _render_camera.get_pos();
+    _camera_data.fov = _render_camera.get_fov();
+    _camera_data.dir = _render_camera.get_dir();
+    _camera_data.width = _render_extent.width;
+    _camera_data.left = _render_camera.get_left();
+    _camera_data.height = _render_extent.height;
+
+    _temporal_data.frame = _scheduler.current();
+
+    /* the bounds only depend on these and hold for the whole window */
+    float window = std::floor(u_time * WEATHER_SPEED / (float)OCCUPANCY_DRIFT);
+    _occupancy_rebuild = window != _occupancy_window ||
+                         _cloud_data.type != _occupancy_cloud.type ||
+                         _cloud_data.freq != _occupancy_cloud.freq ||
+                         _cloud_data.cutoff != _occupancy_cloud.cutoff ||
+                         _cloud_data.density != _occupancy_cloud.density;
+
+    if (_occupancy_rebuild) {
+        _occupancy_window = window;
+        _occupancy_cloud = _cloud_data;
+    }
+
+    /* the weather drifts every frame, a slice a frame keeps every slice at
+       most LIGHT_SLICES frames behind it. the depths also depend on these,
+       slices baked from others would not agree, so a change bakes them all
+       at once. so does the first frame, with nothing to keep yet */
+    bool changed = _cloud_quality != _light_quality ||
+                   _cloud_data.type != _light_cloud.type ||
+                   _cloud_data.freq != _light_cloud.freq ||
+                   _cloud_data.step != _light_cloud.step ||
+                   _cloud_data.cutoff != _light_cloud.cutoff ||
+                   _cloud_data.density != _light_cloud.density ||
+                   _cloud_data.sun_dir != _light_cloud.sun_dir;
+
+    if (changed) {
+        _light_quality = _cloud_quality;
+        _light_cloud = _cloud_data;
+    }
+
+    _light_first = changed ? 0 : _light_slice;
+    _light_count = changed ? LIGHT_SLICES : 1;
+    _light_slice = (_light_first + _light_count) % LIGHT_SLICES;
+}
+
 void vk_engine::draw_comp(frame *frame)
 {
-    vk_cmd::vk_img_layout_transition(frame->cbuffer, _target.img,
-                                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                                     VK_IMAGE_LAYOUT_GENERAL, _fam_index);
+    update_comp();
+
+    if (_record_threads > 0)
+        _graph.execute(frame->comp_cbuffer, &_workers, _comp_fam_index);
+    else
+        _graph.execute(frame->comp_cbuffer);
+
+    /* history now holds a full frame seen from this camera */
+    _prev_camera_data = _camera_data;
+    _temporal_data.reset = 0;
 
-    for (const auto &draw : cs_draw)
-        draw(frame->cbuffer);
+    /* readback_target expects GENERAL */
+    if (_headless)
+        return;
 
-    vk_cmd::vk_img_layout_transition(
-        frame->cbuffer, _target.img, VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, _fam_index);
+    /* release _target to the graphics queue, acquired in draw_present */
+    _graph.release_img(frame->comp_cbuffer, "target",
+                       VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                       _comp_fam_index, _fam_index);
 }
@@ -0,0 +1,178 @@
+#include "vk_bindless.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "vk_boiler.h"
+#include "vk_type.h"
+
+static constexpr VkDescriptorType bindless_types[BINDLESS_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+void bindless_heap::init()
+{
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+    std::vector<VkDescriptorBindingFlags> binding_flags;
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; ++i) {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = i;
+        binding.descriptorType = bindless_types[i];
+        binding.descriptorCount = BINDLESS_CAPACITY[i];
+        binding.stageFlags =
+            VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        layout_bindings.push_back(binding);
+
+        /* slots not yet written, or retired, are never read */
+        binding_flags.push_back(
+            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT);
+
+        pool_sizes.push_back({bindless_types[i], BINDLESS_CAPACITY[i]});
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {};
+    binding_flags_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.pNext = nullptr;
+    binding_flags_info.bindingCount = binding_flags.size();
+    binding_flags_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = layout_bindings.size();
+    layout_info.pBindings = layout_bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_info, nullptr,
+                                         &layout));
+    deletion_queue.push(layout);
+
+    VkDescriptorPoolCreateInfo pool_info =
+        vk_boiler::descriptor_pool_create_info(pool_sizes.size(),
+                                               pool_sizes.data());
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+    deletion_queue.push(pool);
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info =
+        vk_boiler::descriptor_set_allocate_info(pool, &layout);
+
+    VK_CHECK(
+        vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &set));
+}
+
+uint32_t bindless_heap::add_storage_img(VkImageView img_view)
+{
+    uint32_t index = reserve(BINDLESS_STORAGE_IMG);
+    write_storage_img(index, img_view);
+    return index;
+}
+
+uint32_t bindless_heap::add_sampled_img(VkImageView img_view,
+                                        VkSampler sampler,
+                                        VkImageLayout img_layout)
+{
+    uint32_t index = reserve(BINDLESS_SAMPLED_IMG);
+    write_sampled_img(index, img_view, sampler, img_layout);
+    return index;
+}
+
+void bindless_heap::write_storage_img(uint32_t index, VkImageView img_view)
+{
+    VkDescriptorImageInfo descriptor_img_info = {};
+    descriptor_img_info.imageView = img_view;
+    descriptor_img_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
+        &descriptor_img_info, set, BINDLESS_STORAGE_IMG,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    write_set.dstArrayElement = index;
+
+    vkUpdateDescriptorSets(device, 1, &write_set, 0, nullptr);
+}
+
+void bindless_heap::write_sampled_img(uint32_t index, VkImageView img_view,
+                                      VkSampler sampler,
+                                      VkImageLayout img_layout)
+{
+    VkDescriptorImageInfo descriptor_img_info = {};
+    descriptor_img_info.sampler = sampler;
+    descriptor_img_info.imageView = img_view;
+    descriptor_img_info.imageLayout = img_layout;
+
+    VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
+        &descriptor_img_info, set, BINDLESS_SAMPLED_IMG,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    write_set.dstArrayElement = index;
+
+    vkUpdateDescriptorSets(device, 1, &write_set, 0, nullptr);
+}
+
+uint32_t bindless_heap::add_storage_buffer(VkBuffer buffer,
+                                           VkDeviceSize offset,
+                                           VkDeviceSize range)
+{
+    uint32_t index = reserve(BINDLESS_STORAGE_BUFFER);
+
+    VkDescriptorBufferInfo descriptor_buffer_info = {};
+    descriptor_buffer_info.buffer = buffer;
+    descriptor_buffer_info.offset = offset;
+    descriptor_buffer_info.range = range;
+
+    VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
+        &descriptor_buffer_info, set, BINDLESS_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    write_set.dstArrayElement = index;
+
+    vkUpdateDescriptorSets(device, 1, &write_set, 0, nullptr);
+    return index;
+}
+
+void bindless_heap::release(bindless_binding binding, uint32_t index,
+                            uint64_t frame)
+{
+    if (index != BINDLESS_NONE)
+        released.push_back({binding, index, frame});
+}
+
+void bindless_heap::collect(uint64_t completed_frame)
+{
+    auto live = std::stable_partition(
+        released.begin(), released.end(), [=](const released_slot &r) {
+            return r.frame <= completed_frame;
+        });
+
+    for (auto r = released.begin(); r != live; ++r)
+        bindings[r->binding].free.push_back(r->index);
+
+    released.erase(released.begin(), live);
+}
+
+uint32_t bindless_heap::reserve(bindless_binding binding)
+{
+    slots &s = bindings[binding];
+
+    if (!s.free.empty()) {
+        uint32_t index = s.free.back();
+        s.free.pop_back();
+        return index;
+    }
+
+    if (s.next == BINDLESS_CAPACITY[binding]) {
+        std::cerr << "bindless heap: binding " << binding << " is full"
+                  << std::endl;
+        abort();
+    }
+
+    return s.next++;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <volk.h>
+
+constexpr uint32_t BINDLESS_NONE = UINT32_MAX;
+
+/* bindings of the global set, shaders/bindless.glsl declares the same */
+enum bindless_binding : uint32_t {
+    BINDLESS_STORAGE_IMG = 0,
+    BINDLESS_SAMPLED_IMG = 1,
+    BINDLESS_STORAGE_BUFFER = 2,
+    BINDLESS_BINDING_COUNT = 3,
+};
+
+constexpr uint32_t BINDLESS_CAPACITY[BINDLESS_BINDING_COUNT] = {
+    1024,
+    1024,
+    256,
+};
+
+/* one update-after-bind set holding every storage image, sampled image and
+   storage buffer, shaders address them by the index passed in push
+   constants, bound once per command buffer */
+struct bindless_heap {
+public:
+    VkDevice device;
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+
+    void init();
+
+    uint32_t add_storage_img(VkImageView img_view);
+    uint32_t add_sampled_img(VkImageView img_view, VkSampler sampler,
+                             VkImageLayout img_layout);
+    uint32_t add_storage_buffer(VkBuffer buffer, VkDeviceSize offset,
+                                VkDeviceSize range);
+
+    /* an index to write later, for resources whose view does not exist yet,
+       e.g. transients before they are placed */
+    uint32_t reserve(bindless_binding binding);
+    void write_storage_img(uint32_t index, VkImageView img_view);
+    void write_sampled_img(uint32_t index, VkImageView img_view,
+                           VkSampler sampler, VkImageLayout img_layout);
+
+    /* the index is handed out again once frame has retired */
+    void release(bindless_binding binding, uint32_t index, uint64_t frame);
+    void collect(uint64_t completed_frame);
+
+private:
+    struct slots {
+        uint32_t next = 0;
+        std::vector<uint32_t> free;
+    };
+
+    struct released_slot {
+        bindless_binding binding;
+        uint32_t index;
+        uint64_t frame;
+    };
+
+    VkDescriptorPool pool;
+    slots bindings[BINDLESS_BINDING_COUNT];
+    std::vector<released_slot> released;
+};
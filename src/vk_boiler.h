@@ -49,6 +49,17 @@ inline VkSemaphoreCreateInfo sem_create_info()
     return sem_info;
 }
 
+inline VkSemaphoreTypeCreateInfo sem_type_create_info(VkSemaphoreType type,
+                                                      uint64_t value)
+{
+    VkSemaphoreTypeCreateInfo sem_type_info = {};
+    sem_type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    sem_type_info.pNext = nullptr;
+    sem_type_info.semaphoreType = type;
+    sem_type_info.initialValue = value;
+    return sem_type_info;
+}
+
 inline VkRenderingAttachmentInfo
 rendering_attachment_info(VkImageView img_view, VkImageLayout layout,
                           bool clear, VkClearValue clear_value)
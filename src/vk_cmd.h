@@ -4,32 +4,90 @@
 
 namespace vk_cmd
 {
-inline void vk_img_layout_transition(VkCommandBuffer cbuffer, VkImage img,
-                                     VkImageLayout old_layout,
-                                     VkImageLayout new_layout,
-                                     uint32_t family_index)
+/* conservative full barrier for work outside the render graph, waits on and
+   flushes everything before, blocks everything after */
+inline void vk_img_barrier(VkCommandBuffer cbuffer, VkImage img,
+                           VkImageLayout old_layout, VkImageLayout new_layout,
+                           uint32_t src_family_index, uint32_t dst_family_index)
 {
     VkImageSubresourceRange subresource_range = {};
     subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     subresource_range.baseMipLevel = 0;
-    subresource_range.levelCount = 1;
+    subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
     subresource_range.baseArrayLayer = 0;
-    subresource_range.layerCount = 1;
-    VkImageMemoryBarrier img_mem_barrier = {};
-    img_mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    VkImageMemoryBarrier2 img_mem_barrier = {};
+    img_mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
     img_mem_barrier.pNext = nullptr;
-    img_mem_barrier.srcAccessMask = VK_ACCESS_NONE;
-    img_mem_barrier.dstAccessMask = VK_ACCESS_NONE;
+    img_mem_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    img_mem_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    img_mem_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    img_mem_barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
     img_mem_barrier.oldLayout = old_layout;
     img_mem_barrier.newLayout = new_layout;
-    img_mem_barrier.srcQueueFamilyIndex = family_index;
-    img_mem_barrier.dstQueueFamilyIndex = family_index;
+    img_mem_barrier.srcQueueFamilyIndex = src_family_index;
+    img_mem_barrier.dstQueueFamilyIndex = dst_family_index;
     img_mem_barrier.image = img;
     img_mem_barrier.subresourceRange = subresource_range;
 
-    vkCmdPipelineBarrier(cbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0,
-                         nullptr, 1, &img_mem_barrier);
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &img_mem_barrier;
+
+    vkCmdPipelineBarrier2(cbuffer, &dependency_info);
+}
+
+inline void vk_img_layout_transition(VkCommandBuffer cbuffer, VkImage img,
+                                     VkImageLayout old_layout,
+                                     VkImageLayout new_layout,
+                                     uint32_t family_index)
+{
+    vk_img_barrier(cbuffer, img, old_layout, new_layout, family_index,
+                   family_index);
+}
+
+/* record the same barrier on both queues, release on the source family and
+   acquire on the destination family */
+inline void vk_img_ownership_transfer(VkCommandBuffer cbuffer, VkImage img,
+                                      VkImageLayout old_layout,
+                                      VkImageLayout new_layout,
+                                      uint32_t src_family_index,
+                                      uint32_t dst_family_index)
+{
+    vk_img_barrier(cbuffer, img, old_layout, new_layout, src_family_index,
+                   dst_family_index);
+}
+
+/* vk_img_barrier for a range of a buffer */
+inline void vk_buffer_barrier(VkCommandBuffer cbuffer, VkBuffer buffer,
+                              VkDeviceSize offset, VkDeviceSize size,
+                              uint32_t src_family_index,
+                              uint32_t dst_family_index)
+{
+    VkBufferMemoryBarrier2 buffer_mem_barrier = {};
+    buffer_mem_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    buffer_mem_barrier.pNext = nullptr;
+    buffer_mem_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    buffer_mem_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    buffer_mem_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    buffer_mem_barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+    buffer_mem_barrier.srcQueueFamilyIndex = src_family_index;
+    buffer_mem_barrier.dstQueueFamilyIndex = dst_family_index;
+    buffer_mem_barrier.buffer = buffer;
+    buffer_mem_barrier.offset = offset;
+    buffer_mem_barrier.size = size;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.bufferMemoryBarrierCount = 1;
+    dependency_info.pBufferMemoryBarriers = &buffer_mem_barrier;
+
+    vkCmdPipelineBarrier2(cbuffer, &dependency_info);
 }
 
 inline void vk_img_copy(VkCommandBuffer cbuffer, VkExtent3D extent, VkImage src,
@@ -51,4 +109,29 @@ inline void vk_img_copy(VkCommandBuffer cbuffer, VkExtent3D extent, VkImage src,
     vkCmdCopyImage(cbuffer, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst,
                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &img_copy);
 }
+
+/* scale the top left src_extent of src over all of dst */
+inline void vk_img_blit(VkCommandBuffer cbuffer, VkExtent2D src_extent,
+                        VkImage src, VkExtent2D dst_extent, VkImage dst)
+{
+    VkImageBlit img_blit = {};
+    img_blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    img_blit.srcSubresource.mipLevel = 0;
+    img_blit.srcSubresource.baseArrayLayer = 0;
+    img_blit.srcSubresource.layerCount = 1;
+    img_blit.srcOffsets[0] = VkOffset3D{0, 0, 0};
+    img_blit.srcOffsets[1] = VkOffset3D{(int32_t)src_extent.width,
+                                        (int32_t)src_extent.height, 1};
+    img_blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    img_blit.dstSubresource.mipLevel = 0;
+    img_blit.dstSubresource.baseArrayLayer = 0;
+    img_blit.dstSubresource.layerCount = 1;
+    img_blit.dstOffsets[0] = VkOffset3D{0, 0, 0};
+    img_blit.dstOffsets[1] = VkOffset3D{(int32_t)dst_extent.width,
+                                        (int32_t)dst_extent.height, 1};
+
+    vkCmdBlitImage(cbuffer, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &img_blit,
+                   VK_FILTER_LINEAR);
+}
 } // namespace vk_cmd
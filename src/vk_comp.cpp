@@ -1,33 +1,207 @@
 #include "vk_comp.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <numeric>
 
 #include "vk_boiler.h"
 
 void comp_allocator::init()
 {
-    std::vector<VkDescriptorPoolSize> pool_sizes = {
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16},
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 16},
-    };
+    heap.device = device;
+    heap.init();
+
+    VkSamplerCreateInfo sampler_info = vk_boiler::sampler_create_info();
+    VK_CHECK(vkCreateSampler(device, &sampler_info, nullptr, &sampler));
+    deletion_queue.push(sampler);
+
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    VK_CHECK(
+        vkCreateSampler(device, &sampler_info, nullptr, &border_sampler));
+    deletion_queue.push(border_sampler);
 
-    VkDescriptorPoolCreateInfo pool_info =
-        vk_boiler::descriptor_pool_create_info(pool_sizes.size(),
-                                               pool_sizes.data());
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VK_CHECK(
+        vkCreateSampler(device, &sampler_info, nullptr, &repeat_sampler));
+    deletion_queue.push(repeat_sampler);
 
-    vkCreateDescriptorPool(device, &pool_info, nullptr, &comp_descriptor_pool);
+    VkPushConstantRange push_constants = {};
+    push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constants.offset = 0;
+    push_constants.size = COMP_PUSH_CONSTANTS_SIZE;
 
-    deletion_queue.push_back([=]() {
-        vkDestroyDescriptorPool(device, comp_descriptor_pool, nullptr);
-    });
+    std::vector<VkDescriptorSetLayout> layouts = {heap.layout};
+    std::vector<VkPushConstantRange> ranges = {push_constants};
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info =
+        vk_boiler::pipeline_layout_create_info(layouts, ranges);
+
+    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
+                                    &pipeline_layout));
+    deletion_queue.push(pipeline_layout);
+
+    /* uniform ring */
+    VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = UNIFORM_RING_SIZE * frame_count;
+    buffer_info.usage =
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    VmaAllocationCreateInfo vma_allocation_info = {};
+    vma_allocation_info.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+        VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    vma_allocation_info.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VmaAllocationInfo allocation_info = {};
+    VK_CHECK(vmaCreateBuffer(vma_allocator, &buffer_info, &vma_allocation_info,
+                             &ring.buffer.buffer, &ring.buffer.allocation,
+                             &allocation_info));
+    vmaSetAllocationName(vma_allocator, ring.buffer.allocation, "uniform ring");
+
+    ring.buffer.size = buffer_info.size;
+    ring.data = (char *)allocation_info.pMappedData;
+    ring.head = 0;
+    ring.end = UNIFORM_RING_SIZE;
+
+    deletion_queue.push(ring.buffer);
+
+    add_to_heap(ring.buffer, buffer_info.usage);
 }
 
-uint32_t comp_allocator::create_buffer(VkDeviceSize size,
-                                       VkBufferUsageFlags usage,
-                                       VmaAllocationCreateFlags flags,
-                                       std::string name)
+buffer_handle comp_allocator::create_uniform(VkDeviceSize size,
+                                             res_name name)
+{
+    allocated_buffer buffer = ring.buffer;
+    buffer.size = size;
+
+    return buffers.add(name, buffer);
+}
+
+void comp_allocator::destroy_buffer(buffer_handle buffer, uint64_t frame)
+{
+    allocated_buffer &b = buffers[buffer];
+
+    /* uniforms are views of the ring and own nothing */
+    if (b.buffer != ring.buffer.buffer) {
+        heap.release(BINDLESS_STORAGE_BUFFER, b.storage_index, frame);
+        deletion_queue.retire(b, frame);
+    }
+
+    buffers.remove(buffer);
+}
+
+void comp_allocator::destroy_img(img_handle img, uint64_t frame)
+{
+    allocated_img &i = imgs[img];
+
+    heap.release(BINDLESS_STORAGE_IMG, i.storage_index, frame);
+    heap.release(BINDLESS_SAMPLED_IMG, i.sampled_index, frame);
+    deletion_queue.retire(i, frame);
+
+    /* level 0 is storage_index */
+    if (mip_chain *m = find_mip_chain(img)) {
+        for (uint32_t mip = 1; mip < m->views.size(); ++mip)
+            heap.release(BINDLESS_STORAGE_IMG, m->storage_indices[mip], frame);
+
+        for (uint32_t slot : m->deletion_slots)
+            deletion_queue.retire_slot(slot, frame);
+
+        mip_chains.erase(mip_chains.begin() + (m - mip_chains.data()));
+    }
+
+    /* the shared memory stays with the others in it */
+    if (transient_img *t = find_transient(img))
+        transients.erase(transients.begin() + (t - transients.data()));
+
+    imgs.remove(img);
+}
+
+buffer_handle comp_allocator::load_buffer(res_name name,
+                                          allocated_buffer buffer,
+                                          VkBufferUsageFlags usage)
+{
+    if (buffer.allocation)
+        vmaSetAllocationName(vma_allocator, buffer.allocation, name.str);
+
+    add_to_heap(buffer, usage);
+    return buffers.add(name, buffer);
+}
+
+img_handle comp_allocator::load_img(res_name name, allocated_img img,
+                                    VkImageUsageFlags usage)
+{
+    if (img.allocation)
+        vmaSetAllocationName(vma_allocator, img.allocation, name.str);
+
+    add_to_heap(img, usage);
+    return imgs.add(name, img);
+}
+
+void comp_allocator::bind(VkCommandBuffer cbuffer)
+{
+    vkCmdBindDescriptorSets(cbuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipeline_layout, 0, 1, &heap.set, 0, nullptr);
+}
+
+void comp_allocator::add_to_heap(allocated_buffer &buffer,
+                                 VkBufferUsageFlags usage)
+{
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+        buffer.storage_index =
+            heap.add_storage_buffer(buffer.buffer, 0, buffer.size);
+}
+
+void comp_allocator::add_to_heap(allocated_img &img, VkImageUsageFlags usage,
+                                 VkSampler img_sampler)
+{
+    /* a storage view covers one level, see create_mip_views */
+    if (usage & VK_IMAGE_USAGE_STORAGE_BIT && img.mip_levels == 1)
+        img.storage_index = heap.add_storage_img(img.img_view);
+
+    /* compute images stay in GENERAL */
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+        img.sampled_index = heap.add_sampled_img(
+            img.img_view, img_sampler ? img_sampler : sampler,
+            VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void comp_allocator::begin_frame(uint32_t frame_index)
+{
+    ring.head = frame_index * UNIFORM_RING_SIZE;
+    ring.end = ring.head + UNIFORM_RING_SIZE;
+}
+
+uint32_t comp_allocator::push_uniform(const void *data, size_t size)
+{
+    /* shaders read the ring as vec4s */
+    VkDeviceSize alignment = std::max<VkDeviceSize>(min_buffer_alignment, 16);
+    VkDeviceSize aligned_size = (size + alignment - 1) & ~(alignment - 1);
+
+    VkDeviceSize offset =
+        ring.head.fetch_add(aligned_size, std::memory_order_relaxed);
+
+    if (offset + aligned_size > ring.end) {
+        std::cerr << "uniform ring: out of space for this frame" << std::endl;
+        abort();
+    }
+
+    std::memcpy(ring.data + offset, data, size);
+    vmaFlushAllocation(vma_allocator, ring.buffer.allocation, offset, size);
+
+    return offset;
+}
+
+buffer_handle comp_allocator::create_buffer(VkDeviceSize size,
+                                            VkBufferUsageFlags usage,
+                                            VmaAllocationCreateFlags flags,
+                                            res_name name)
 {
     allocated_buffer buffer;
 
@@ -41,169 +215,269 @@ uint32_t comp_allocator::create_buffer(VkDeviceSize size,
 
     VK_CHECK(vmaCreateBuffer(vma_allocator, &buffer_info, &vma_allocation_info,
                              &buffer.buffer, &buffer.allocation, nullptr));
+    vmaSetAllocationName(vma_allocator, buffer.allocation, name.str);
 
     buffer.size = size;
 
-    deletion_queue.push_back([=]() {
-        vmaDestroyBuffer(vma_allocator, buffer.buffer, buffer.allocation);
-    });
+    deletion_queue.push(buffer);
+    add_to_heap(buffer, usage);
 
-    buffers.push_back(buffer);
-    uint32_t id = buffers.size() - 1;
-    buffer_id.push_back(name);
-    return id;
+    return buffers.add(name, buffer);
 }
 
-uint32_t comp_allocator::create_img(VkFormat format, VkExtent3D extent,
-                                    VkImageAspectFlags aspect,
-                                    VkImageUsageFlags usage,
-                                    VmaAllocationCreateFlags flags,
-                                    std::string name)
+img_handle comp_allocator::create_img(VkFormat format, VkExtent3D extent,
+                                      VkImageAspectFlags aspect,
+                                      VkImageUsageFlags usage,
+                                      VmaAllocationCreateFlags flags,
+                                      res_name name, uint32_t mip_levels,
+                                      VkSampler img_sampler)
 {
     allocated_img img;
 
     VkImageCreateInfo img_info =
         vk_boiler::img_create_info(format, extent, usage);
+    img_info.mipLevels = mip_levels;
 
     VmaAllocationCreateInfo vma_allocation_info = {};
     vma_allocation_info.flags = flags;
     vma_allocation_info.usage = VMA_MEMORY_USAGE_AUTO;
 
+    img.extent = extent;
     img.format = format;
+    img.mip_levels = mip_levels;
 
     VK_CHECK(vmaCreateImage(vma_allocator, &img_info, &vma_allocation_info,
                             &img.img, &img.allocation, nullptr));
-
-    deletion_queue.push_back(
-        [=]() { vmaDestroyImage(vma_allocator, img.img, img.allocation); });
+    vmaSetAllocationName(vma_allocator, img.allocation, name.str);
 
     VkImageViewCreateInfo img_view_info =
         vk_boiler::img_view_create_info(aspect, img.img, extent, format);
+    img_view_info.subresourceRange.levelCount = mip_levels;
 
     VK_CHECK(vkCreateImageView(device, &img_view_info, nullptr, &img.img_view));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyImageView(device, img.img_view, nullptr); });
+    deletion_queue.push(img);
+    add_to_heap(img, usage, img_sampler);
+
+    img_handle id = imgs.add(name, img);
+
+    if (mip_levels > 1 && usage & VK_IMAGE_USAGE_STORAGE_BIT)
+        create_mip_views(id, aspect);
 
-    imgs.push_back(img);
-    uint32_t id = imgs.size() - 1;
-    img_id.push_back(name);
     return id;
 }
 
-VkDescriptorSetLayout comp_allocator::create_descriptor_set_layout(
-    std::vector<VkDescriptorType> &types)
+img_handle comp_allocator::create_transient_img(VkFormat format,
+                                                VkExtent3D extent,
+                                                VkImageAspectFlags aspect,
+                                                VkImageUsageFlags usage,
+                                                res_name name,
+                                                uint32_t mip_levels,
+                                                VkSampler img_sampler)
 {
-    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    allocated_img img = {};
+    img.extent = extent;
+    img.format = format;
+    img.mip_levels = mip_levels;
 
-    VkDescriptorSetLayoutCreateInfo layout_info =
-        vk_boiler::descriptor_set_layout_create_info(
-            types, VK_SHADER_STAGE_COMPUTE_BIT);
+    /* written once the view exists */
+    if (usage & VK_IMAGE_USAGE_STORAGE_BIT)
+        img.storage_index = heap.reserve(BINDLESS_STORAGE_IMG);
 
-    VK_CHECK(
-        vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &layout));
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+        img.sampled_index = heap.reserve(BINDLESS_SAMPLED_IMG);
+
+    VkImageCreateInfo img_info =
+        vk_boiler::img_create_info(format, extent, usage);
+    img_info.mipLevels = mip_levels;
+
+    img_handle id = imgs.add(name, img);
+    transients.push_back(
+        {id, img_info, aspect, img_sampler ? img_sampler : sampler});
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyDescriptorSetLayout(device, layout, nullptr); });
+    return id;
+}
+
+uint32_t comp_allocator::mip_storage_index(img_handle img, uint32_t mip)
+{
+    mip_chain *m = find_mip_chain(img);
 
-    return layout;
+    if (!m || mip >= m->storage_indices.size()) {
+        std::cerr << "comp allocator: no storage view of mip " << mip
+                  << std::endl;
+        abort();
+    }
+
+    return m->storage_indices[mip];
 }
 
-VkDescriptorSet
-comp_allocator::allocate_descriptor_set(VkDescriptorSetLayout layout)
+bool comp_allocator::transient(img_handle img)
 {
-    VkDescriptorSet set = VK_NULL_HANDLE;
+    return find_transient(img) != nullptr;
+}
 
-    VkDescriptorSetAllocateInfo descriptor_set_allocate_info =
-        vk_boiler::descriptor_set_allocate_info(comp_descriptor_pool, &layout);
+comp_allocator::transient_img *comp_allocator::find_transient(img_handle img)
+{
+    for (auto &t : transients)
+        if (t.img.index == img.index && t.img.generation == img.generation)
+            return &t;
 
-    VK_CHECK(
-        vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &set));
-
-    return set;
-};
-
-void cs::write_descriptor_set(std::vector<VkDescriptorType> types,
-                              std::vector<std::string> names)
-{
-    for (uint32_t i = 0; i < types.size(); ++i) {
-        VkDescriptorType type = types[i];
-        std::string name = names[i];
-
-        /* write descriptor sets with preset for each descriptor type */
-        switch (type) {
-        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC: {
-            uint32_t buffer_id = allocator->get_buffer_id(name);
-            VkDescriptorBufferInfo descriptor_buffer_info = {};
-            descriptor_buffer_info.buffer =
-                allocator->buffers[buffer_id].buffer;
-            descriptor_buffer_info.offset = 0;
-            descriptor_buffer_info.range =
-                pad_uniform_buffer_size(allocator->buffers[buffer_id].size);
-
-            VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
-                &descriptor_buffer_info, set, i,
-                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
-
-            vkUpdateDescriptorSets(device, 1, &write_set, 0, nullptr);
-        } break;
-
-        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: {
-            uint32_t img_id = allocator->get_img_id(name);
-            VkDescriptorImageInfo descriptor_img_info = {};
-            descriptor_img_info.imageView = allocator->imgs[img_id].img_view;
-            descriptor_img_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-            VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
-                &descriptor_img_info, set, i, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-
-            vkUpdateDescriptorSets(device, 1, &write_set, 0, nullptr);
-        } break;
-
-        default:
-            break;
-        }
+    return nullptr;
+}
+
+comp_allocator::mip_chain *comp_allocator::find_mip_chain(img_handle img)
+{
+    for (auto &m : mip_chains)
+        if (m.img.index == img.index && m.img.generation == img.generation)
+            return &m;
+
+    return nullptr;
+}
+
+void comp_allocator::create_mip_views(img_handle id, VkImageAspectFlags aspect)
+{
+    allocated_img &img = imgs[id];
+    mip_chain m = {id};
+
+    for (uint32_t mip = 0; mip < img.mip_levels; ++mip) {
+        VkImageViewCreateInfo img_view_info = vk_boiler::img_view_create_info(
+            aspect, img.img, img.extent, img.format);
+        img_view_info.subresourceRange.baseMipLevel = mip;
+
+        VkImageView view;
+        VK_CHECK(vkCreateImageView(device, &img_view_info, nullptr, &view));
+        m.deletion_slots.push_back(deletion_queue.push(view));
+
+        /* a transient reserved the index of level 0 before it had a view */
+        uint32_t index = img.storage_index;
+        if (mip == 0 && index != BINDLESS_NONE)
+            heap.write_storage_img(index, view);
+        else
+            index = heap.add_storage_img(view);
+
+        m.views.push_back(view);
+        m.storage_indices.push_back(index);
     }
+
+    img.storage_index = m.storage_indices[0];
+    mip_chains.push_back(m);
 }
 
-bool cs::load_shader_module(const char *filename)
+std::vector<uint32_t> comp_allocator::place_transients(
+    const std::vector<transient_lifetime> &lifetimes)
 {
-    std::ifstream f(filename, std::ios::ate | std::ios::binary);
+    struct alias_slot {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        uint32_t last;
+    };
 
-    if (!f.is_open()) {
-        std::cerr << "shader: " << filename << " not exist" << std::endl;
-        return false;
+    std::vector<alias_slot> slots;
+    std::vector<uint32_t> placement(lifetimes.size());
+
+    if (lifetimes.empty())
+        return placement;
+
+    if (transient_memory != VK_NULL_HANDLE) {
+        std::cerr << "comp allocator: transients are already placed"
+                  << std::endl;
+        abort();
     }
 
-    size_t size = f.tellg();
-    std::vector<uint32_t> buffer(size / sizeof(uint32_t));
+    /* interval colouring, earliest first into the first slot already free */
+    std::vector<uint32_t> order(lifetimes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return lifetimes[a].first < lifetimes[b].first;
+    });
 
-    f.seekg(0);
-    f.read((char *)buffer.data(), size);
-    f.close();
+    uint32_t memory_type_bits = UINT32_MAX;
+    VkDeviceSize unaliased = 0;
 
-    VkShaderModuleCreateInfo shader_module_info = {};
-    shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shader_module_info.pNext = nullptr;
-    shader_module_info.codeSize = buffer.size() * sizeof(uint32_t);
-    shader_module_info.pCode = buffer.data();
+    for (uint32_t i : order) {
+        transient_img *t = find_transient(lifetimes[i].img);
 
-    VK_CHECK(
-        vkCreateShaderModule(device, &shader_module_info, nullptr, &module));
+        VkDeviceImageMemoryRequirements img_requirements = {};
+        img_requirements.sType =
+            VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+        img_requirements.pCreateInfo = &t->img_info;
 
-    VkDevice copy_device = device;
-    VkShaderModule copy_module = module;
-    deletion_queue.push_back(
-        [=]() { vkDestroyShaderModule(copy_device, copy_module, nullptr); });
+        VkMemoryRequirements2 requirements = {};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        vkGetDeviceImageMemoryRequirements(device, &img_requirements,
+                                           &requirements);
 
-    return true;
-}
+        const VkMemoryRequirements &r = requirements.memoryRequirements;
+        memory_type_bits &= r.memoryTypeBits;
+        unaliased += r.size;
 
-size_t cs::pad_uniform_buffer_size(size_t original_size)
-{
-    size_t aligned_size = original_size;
-    if (min_buffer_alignment > 0)
-        aligned_size = (aligned_size + min_buffer_alignment - 1) &
-                       ~(min_buffer_alignment - 1);
-    return aligned_size;
+        uint32_t slot = 0;
+        while (slot < slots.size() && slots[slot].last >= lifetimes[i].first)
+            ++slot;
+
+        if (slot == slots.size())
+            slots.push_back({0, 0, 1, 0});
+
+        slots[slot].size = std::max(slots[slot].size, r.size);
+        slots[slot].alignment = std::max(slots[slot].alignment, r.alignment);
+        slots[slot].last = lifetimes[i].last;
+        placement[i] = slot;
+    }
+
+    VkMemoryRequirements requirements = {0, 1, memory_type_bits};
+    for (auto &slot : slots) {
+        slot.offset = (requirements.size + slot.alignment - 1) /
+                      slot.alignment * slot.alignment;
+        requirements.size = slot.offset + slot.size;
+        requirements.alignment =
+            std::max(requirements.alignment, slot.alignment);
+    }
+
+    VmaAllocationCreateInfo vma_allocation_info = {};
+    vma_allocation_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VK_CHECK(vmaAllocateMemory(vma_allocator, &requirements,
+                               &vma_allocation_info, &transient_memory,
+                               nullptr));
+    vmaSetAllocationName(vma_allocator, transient_memory, "transients");
+
+    /* flushed in reverse, after the images aliasing it */
+    deletion_queue.push(transient_memory);
+
+    for (uint32_t i = 0; i < lifetimes.size(); ++i) {
+        transient_img *t = find_transient(lifetimes[i].img);
+        allocated_img &img = imgs[t->img];
+
+        VK_CHECK(vmaCreateAliasingImage2(vma_allocator, transient_memory,
+                                         slots[placement[i]].offset,
+                                         &t->img_info, &img.img));
+
+        VkImageViewCreateInfo img_view_info = vk_boiler::img_view_create_info(
+            t->aspect, img.img, img.extent, img.format);
+        img_view_info.subresourceRange.levelCount = img.mip_levels;
+
+        VK_CHECK(
+            vkCreateImageView(device, &img_view_info, nullptr, &img.img_view));
+
+        /* the memory is not the image's to free */
+        deletion_queue.push(img);
+
+        if (img.storage_index != BINDLESS_NONE) {
+            if (img.mip_levels > 1)
+                create_mip_views(t->img, t->aspect);
+            else
+                heap.write_storage_img(img.storage_index, img.img_view);
+        }
+
+        if (img.sampled_index != BINDLESS_NONE)
+            heap.write_sampled_img(img.sampled_index, img.img_view, t->sampler,
+                                   VK_IMAGE_LAYOUT_GENERAL);
+    }
+
+    std::cout << "transients: " << lifetimes.size() << " images in "
+              << slots.size() << " slots, " << requirements.size / 1024
+              << " KB instead of " << unaliased / 1024 << " KB" << std::endl;
+
+    return placement;
 }
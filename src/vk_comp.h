@@ -1,95 +1,192 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <volk.h>
 
 #include "vk_mem_alloc.h"
 
+#include "vk_bindless.h"
+#include "vk_handle.h"
+#include "vk_shader.h"
 #include "vk_type.h"
 
-typedef std::pair<VkDescriptorType, std::string> descriptor;
+constexpr VkDeviceSize UNIFORM_RING_SIZE = 256 * 1024;
+
+/* one push constant range shared by every compute pipeline */
+constexpr uint32_t COMP_PUSH_CONSTANTS_SIZE = 128;
+
+typedef handle<allocated_buffer> buffer_handle;
+typedef handle<allocated_img> img_handle;
+
+/* first and last pass using a transient within a frame */
+struct transient_lifetime {
+    img_handle img;
+    uint32_t first;
+    uint32_t last;
+};
+
+/* persistently mapped, one region of UNIFORM_RING_SIZE per frame in flight */
+struct uniform_ring {
+    allocated_buffer buffer;
+    char *data;
+    /* bumped by every recording thread */
+    std::atomic<VkDeviceSize> head;
+    VkDeviceSize end;
+};
 
 struct comp_allocator {
 public:
-    std::vector<allocated_buffer> buffers;
-    std::vector<allocated_img> imgs;
+    registry<allocated_buffer> buffers;
+    registry<allocated_img> imgs;
+
+    /* storage images, sampled images and storage buffers are written here
+       as they are created, every compute pipeline uses pipeline_layout */
+    bindless_heap heap;
+    VkPipelineLayout pipeline_layout;
+    /* nearest, the default of sampled images */
+    VkSampler sampler;
+    /* trilinear across mip levels, repeating or clamped to a zero border */
+    VkSampler repeat_sampler;
+    VkSampler border_sampler;
 
     VkDevice device;
     VmaAllocator vma_allocator;
-
-    uint32_t create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                           VmaAllocationCreateFlags flags, std::string name);
-
-    uint32_t create_img(VkFormat format, VkExtent3D extent,
-                        VkImageAspectFlags aspect, VkImageUsageFlags usage,
-                        VmaAllocationCreateFlags flags, std::string name);
-
-    uint32_t get_buffer_id(std::string name)
+    VkDeviceSize min_buffer_alignment;
+    uint32_t frame_count;
+
+    buffer_handle create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                VmaAllocationCreateFlags flags,
+                                res_name name);
+
+    /* with more than one mip level, storage_index is mip 0 and every level
+       has a storage index of its own, see mip_storage_index. img_sampler
+       replaces sampler for this image */
+    img_handle create_img(VkFormat format, VkExtent3D extent,
+                          VkImageAspectFlags aspect, VkImageUsageFlags usage,
+                          VmaAllocationCreateFlags flags, res_name name,
+                          uint32_t mip_levels = 1,
+                          VkSampler img_sampler = VK_NULL_HANDLE);
+
+    /* an image without memory of its own until place_transients, the first
+       pass using it each frame must overwrite it, nothing survives from one
+       frame to the next. heap indices are valid right away */
+    img_handle create_transient_img(VkFormat format, VkExtent3D extent,
+                                    VkImageAspectFlags aspect,
+                                    VkImageUsageFlags usage, res_name name,
+                                    uint32_t mip_levels = 1,
+                                    VkSampler img_sampler = VK_NULL_HANDLE);
+
+    /* of one level of an image with mip levels and storage usage, valid
+       once the image has memory */
+    uint32_t mip_storage_index(img_handle img, uint32_t mip);
+
+    bool transient(img_handle img);
+
+    /* once, after every pass is known. back every transient with one
+       allocation, those whose lifetimes do
+       not overlap alias the same range. returns the alias slot of each, in
+       order, transients in one slot need a barrier between them */
+    std::vector<uint32_t>
+    place_transients(const std::vector<transient_lifetime> &lifetimes);
+
+    /* what place_transients allocated, VK_NULL_HANDLE before */
+    VmaAllocation transient_memory = VK_NULL_HANDLE;
+
+    /* named view of the uniform ring, bind as UNIFORM_BUFFER_DYNAMIC and
+       pass the offset returned by push_uniform */
+    buffer_handle create_uniform(VkDeviceSize size, res_name name);
+
+    /* heap index of the whole ring as a storage buffer, shaders read
+       push_uniform data from it at the returned offset */
+    inline uint32_t uniform_index() { return ring.buffer.storage_index; };
+
+    /* forget a resource from create_* now and free it once frame, the last
+       one using it, has retired, the handle is stale from here on */
+    void destroy_buffer(buffer_handle buffer, uint64_t frame);
+    void destroy_img(img_handle img, uint64_t frame);
+
+    void begin_frame(uint32_t frame_index);
+    uint32_t push_uniform(const void *data, size_t size);
+
+    /* abort on unknown names, use buffers.find to probe */
+    inline buffer_handle get_buffer_id(res_name name)
     {
-        uint32_t i = 0;
-        for (i = 0; i < buffer_id.size(); ++i)
-            if (buffer_id[i] == name)
-                return i;
-        return i;
+        return buffers.get_handle(name);
     };
 
-    uint32_t get_img_id(std::string name)
+    inline img_handle get_img_id(res_name name)
     {
-        uint32_t i = 0;
-        for (i = 0; i < img_id.size(); ++i)
-            if (img_id[i] == name)
-                return i;
-        return i;
+        return imgs.get_handle(name);
     };
 
-    void load_buffer(std::string name, allocated_buffer buffer)
+    inline uint32_t storage_index(res_name name)
     {
-        buffers.push_back(buffer);
-        buffer_id.push_back(name);
+        return imgs[get_img_id(name)].storage_index;
     };
 
-    void load_img(std::string name, allocated_img img)
+    inline uint32_t sampled_index(res_name name)
     {
-        imgs.push_back(img);
-        img_id.push_back(name);
-    }
+        return imgs[get_img_id(name)].sampled_index;
+    };
 
-    VkDescriptorSetLayout
-    create_descriptor_set_layout(std::vector<VkDescriptorType> &types);
+    /* resources created outside, the caller keeps ownership, usage picks
+       what goes into the heap */
+    buffer_handle load_buffer(res_name name, allocated_buffer buffer,
+                              VkBufferUsageFlags usage);
+    img_handle load_img(res_name name, allocated_img img,
+                        VkImageUsageFlags usage);
 
-    VkDescriptorSet allocate_descriptor_set(VkDescriptorSetLayout layout);
+    /* binds the heap for every compute pass recorded into cbuffer */
+    void bind(VkCommandBuffer cbuffer);
 
     void init();
 
 private:
-    VkDescriptorPool comp_descriptor_pool;
-    std::vector<std::string> buffer_id;
-    std::vector<std::string> img_id;
+    uniform_ring ring;
+
+    struct transient_img {
+        img_handle img;
+        VkImageCreateInfo img_info;
+        VkImageAspectFlags aspect;
+        VkSampler sampler;
+    };
+
+    std::vector<transient_img> transients;
+
+    /* single level storage views of an image with mip levels */
+    struct mip_chain {
+        img_handle img;
+        std::vector<VkImageView> views;
+        std::vector<uint32_t> storage_indices;
+        std::vector<uint32_t> deletion_slots;
+    };
+
+    std::vector<mip_chain> mip_chains;
+
+    transient_img *find_transient(img_handle img);
+    mip_chain *find_mip_chain(img_handle img);
+    void create_mip_views(img_handle img, VkImageAspectFlags aspect);
+
+    void add_to_heap(allocated_buffer &buffer, VkBufferUsageFlags usage);
+    void add_to_heap(allocated_img &img, VkImageUsageFlags usage,
+                     VkSampler img_sampler = VK_NULL_HANDLE);
 };
 
+/* a compute shader on the shared layout, resources come from the heap */
 struct cs {
 public:
-    cs(comp_allocator *allocator, std::vector<descriptor> descriptors,
-       std::string shader_file, VkDeviceSize min_buffer_alignment)
-        : allocator(allocator), min_buffer_alignment(min_buffer_alignment)
+    /* shader is a file name in shaders/, e.g. "cloud.comp" */
+    cs(comp_allocator *allocator, const char *shader)
+        : allocator(allocator)
     {
         device = allocator->device;
+        set = allocator->heap.set;
+        layout = allocator->heap.layout;
+        pipeline_layout = allocator->pipeline_layout;
 
-        std::vector<VkDescriptorType> types;
-        std::vector<std::string> names;
-
-        for (uint32_t i = 0; i < descriptors.size(); ++i) {
-            types.push_back(descriptors[i].first);
-            names.push_back(descriptors[i].second);
-        }
-
-        layout = allocator->create_descriptor_set_layout(types);
-        set = allocator->allocate_descriptor_set(layout);
-
-        write_descriptor_set(types, names);
-
-        load_shader_module(shader_file.data());
+        module = shader_cache.get(shader);
     };
 
     comp_allocator *allocator;
@@ -101,12 +198,5 @@ public:
     VkPipelineLayout pipeline_layout;
 
 private:
-    VkDeviceSize min_buffer_alignment;
     VkDevice device;
-
-    void write_descriptor_set(std::vector<VkDescriptorType> types,
-                              std::vector<std::string> names);
-
-    bool load_shader_module(const char *filename);
-    size_t pad_uniform_buffer_size(size_t original_size);
 };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <volk.h>
+
+/* dynamic resolution, scales the internal render extent so the gpu frame time
+   holds budget_ms */
+struct drs_controller {
+public:
+    bool enabled = true;
+    float budget_ms = 8.f;
+    float min_scale = .5f;
+    float max_scale = 1.f;
+    float scale = 1.f;
+
+    /* feed the gpu time of a retired frame, each frame is used once */
+    void update(uint64_t frame_number, float gpu_ms)
+    {
+        if (!enabled) {
+            scale = max_scale;
+            return;
+        }
+
+        if (frame_number == last_frame || gpu_ms <= 0.f)
+            return;
+
+        last_frame = frame_number;
+
+        /* ignore noise around the budget */
+        if (std::abs(gpu_ms - budget_ms) < budget_ms * .05f)
+            return;
+
+        /* cost grows with pixel count, the scale squared, move part of the
+           way since the sample is frames in flight old */
+        float ideal = scale * std::sqrt(budget_ms / gpu_ms);
+        scale = std::clamp(scale + (ideal - scale) * .25f, min_scale,
+                           max_scale);
+    }
+
+    VkExtent2D extent(VkExtent2D full)
+    {
+        VkExtent2D scaled;
+        scaled.width = std::max<uint32_t>(full.width * scale, 8);
+        scaled.height = std::max<uint32_t>(full.height * scale, 8);
+        return scaled;
+    }
+
+private:
+    uint64_t last_frame = 0;
+};
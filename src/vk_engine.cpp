@@ -1,6 +1,9 @@
 ﻿#include "vk_engine.h"
 
-#include <future>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <thread>
 #include <vector>
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
@@ -27,12 +30,14 @@
 void vk_engine::init()
 {
     /* initialize SDL and create a window with it */
-    SDL_Init(SDL_INIT_VIDEO);
+    if (!_headless) {
+        SDL_Init(SDL_INIT_VIDEO);
 
-    _window = SDL_CreateWindow("vk_engine", _window_extent.width,
-                               _window_extent.height, SDL_WINDOW_VULKAN);
+        _window = SDL_CreateWindow("vk_engine", _window_extent.width,
+                                   _window_extent.height, SDL_WINDOW_VULKAN);
 
-    deletion_queue.push_back([=]() { SDL_DestroyWindow(_window); });
+        deletion_queue.push_back([=, this]() { SDL_DestroyWindow(_window); });
+    }
 
     device_init();
 
@@ -85,14 +90,42 @@ void vk_engine::init()
 
     vma_init();
 
-    swapchain_init();
+    if (!_headless)
+        swapchain_init();
+
+    target_init();
     command_init();
     sync_init();
 
+    _comp_allocator.device = _device;
+    _comp_allocator.vma_allocator = _allocator;
+    _comp_allocator.min_buffer_alignment = _min_buffer_alignment;
+    _comp_allocator.frame_count = _scheduler.frame_overlap;
+    _comp_allocator.init();
+
+    /* headless runs keep a fixed resolution to stay comparable */
+    _drs.enabled = !_headless;
+
+    _graph.allocator = &_comp_allocator;
+    _graph.profiler = &_profiler;
+
+    _memory.allocator = _allocator;
+    _memory.resources = &_comp_allocator;
+
+    _uploader.device = _device;
+    _uploader.allocator = _allocator;
+    _uploader.queue = _transfer_queue;
+    _uploader.family_index = _transfer_fam_index;
+    _uploader.dst_family_index = _fam_index;
+    _uploader.init();
+
     descriptor_init();
     // pipeline_init();
 
-    imgui_init();
+    if (!_headless)
+        imgui_init();
+
+    _camera_buffer.write(_vk_camera);
 
     // load_meshes();
     // std::cout << "meshes size " << _meshes.size() << std::endl;
@@ -100,14 +133,17 @@ void vk_engine::init()
     // upload_textures(_meshes.data(), _meshes.size());
 
     comp_init();
+
+    /* every pipeline is built by now */
+    pipeline_cache.log();
+    shader_cache.clear();
 }
 
 void vk_engine::descriptor_init()
 {
+    /* textures live in the bindless heap of _comp_allocator */
     std::vector<VkDescriptorPoolSize> pool_sizes = {
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16},
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 16},
     };
 
     VkDescriptorPoolCreateInfo pool_info =
@@ -117,8 +153,7 @@ void vk_engine::descriptor_init()
     VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr,
                                     &_descriptor_pool));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr); });
+    deletion_queue.push(_descriptor_pool);
 
     /* render mat layout and set */
     VkDescriptorSetLayoutCreateInfo render_mat_layout_info =
@@ -131,9 +166,7 @@ void vk_engine::descriptor_init()
     VK_CHECK(vkCreateDescriptorSetLayout(_device, &render_mat_layout_info,
                                          nullptr, &_render_mat_layout));
 
-    deletion_queue.push_back([=]() {
-        vkDestroyDescriptorSetLayout(_device, _render_mat_layout, nullptr);
-    });
+    deletion_queue.push(_render_mat_layout);
 
     VkDescriptorSetAllocateInfo descriptor_set_allocate_info =
         vk_boiler::descriptor_set_allocate_info(_descriptor_pool,
@@ -141,28 +174,13 @@ void vk_engine::descriptor_init()
 
     VK_CHECK(vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info,
                                       &_render_mat_set));
-
-    /* texture layout */
-    VkDescriptorSetLayoutCreateInfo texture_data_layout_info =
-        vk_boiler::descriptor_set_layout_create_info(
-            std::vector<VkDescriptorType>{
-                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            },
-            VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    VK_CHECK(vkCreateDescriptorSetLayout(_device, &texture_data_layout_info,
-                                         nullptr, &_texture_layout));
-
-    deletion_queue.push_back([=]() {
-        vkDestroyDescriptorSetLayout(_device, _texture_layout, nullptr);
-    });
 }
 
 void vk_engine::pipeline_init()
 {
     /* build graphics pipeline */
-    _vert = load_shader_module("../shaders/.vert.spv");
-    _frag = load_shader_module("../shaders/.frag.spv");
+    _vert = shader_cache.get(".vert");
+    _frag = shader_cache.get(".frag");
 
     PipelineBuilder gfx_pipeline_builder = {};
     gfx_pipeline_builder._shader_stage_infos.push_back(
@@ -190,10 +208,16 @@ void vk_engine::pipeline_init()
 
     std::vector<VkDescriptorSetLayout> layouts = {
         _render_mat_layout,
-        _texture_layout,
+        _comp_allocator.heap.layout,
     };
 
-    std::vector<VkPushConstantRange> push_constants = {};
+    /* bindless index of the mesh texture */
+    VkPushConstantRange texture_pc = {};
+    texture_pc.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    texture_pc.offset = 0;
+    texture_pc.size = sizeof(uint32_t);
+
+    std::vector<VkPushConstantRange> push_constants = {texture_pc};
 
     _gfx_pipeline_layout =
         gfx_pipeline_builder.build_layout(_device, layouts, push_constants);
@@ -206,29 +230,122 @@ void vk_engine::draw()
 {
     /* block cpu accessing frame in used */
     frame *frame = get_current_frame();
-    VK_CHECK(vkWaitForFences(_device, 1, &frame->fence, VK_TRUE, UINT64_MAX));
-    VK_CHECK(vkResetFences(_device, 1, &frame->fence));
 
+    uint64_t cpu_begin = SDL_GetTicksNS();
+
+    /* one consistent camera for everything recorded this frame */
+    _render_camera = _camera_buffer.read();
+
+    /* free what frames the gpu has finished with last used */
+    uint64_t completed = _scheduler.completed();
+    deletion_queue.collect(completed);
+    _comp_allocator.heap.collect(completed);
+    _geometry.collect(completed);
+
+    /* the frame that last counted into this slot has retired, read it back
+       and clear it for this one */
+    march_stats &stats = _march_stats[_scheduler.current() % MAX_FRAME_OVERLAP];
+    VmaAllocation stats_allocation =
+        _comp_allocator.buffers[_march_stats_buffer].allocation;
+
+    vmaInvalidateAllocation(_comp_allocator.vma_allocator, stats_allocation, 0,
+                            VK_WHOLE_SIZE);
+    if (stats.pixels > 0) {
+        _march_steps_per_pixel = (float)stats.steps / stats.pixels;
+        _march_pixels = stats.pixels;
+    }
+
+    stats = {};
+    vmaFlushAllocation(_comp_allocator.vma_allocator, stats_allocation, 0,
+                       VK_WHOLE_SIZE);
+
+    /* the gpu is done with this frame's uniforms and secondaries */
+    _comp_allocator.begin_frame(_frame_index);
+
+    if (_record_threads > 0)
+        _workers.begin_frame(_frame_index);
+
+    /* prepare command buffer */
+    VkCommandBufferBeginInfo cbuffer_begin_info =
+        vk_boiler::cbuffer_begin_info();
+
+    /* begin compute command buffer recording */
+    VK_CHECK(vkBeginCommandBuffer(frame->comp_cbuffer, &cbuffer_begin_info));
+
+    /* timestamps of the frame that last used this slot are ready */
+    _profiler.begin_frame(frame->comp_cbuffer, &frame->queries,
+                          _scheduler.current());
+
+    /* size this frame from the newest retired one */
+    _drs.update(_profiler.results_frame, _profiler.total_ms());
+    _render_extent = _drs.extent(_resolution);
+
+    if (!_headless)
+        draw_imgui();
+
+    /* draw with comp */
+    draw_comp(frame);
+
+    VK_CHECK(vkEndCommandBuffer(frame->comp_cbuffer));
+
+    /* the previous frame must have copied _target out before the cloud pass
+       overwrites it, the frame retires on the compute queue when headless */
+    VkPipelineStageFlags comp_stage_flags =
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    uint64_t wait_value = _scheduler.current() - 1;
+    uint64_t signal_value = _scheduler.current();
+    VkSemaphore signal_sem = _headless ? _scheduler.timeline : frame->comp_sem;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext = nullptr;
+    timeline_info.waitSemaphoreValueCount = 1;
+    timeline_info.pWaitSemaphoreValues = &wait_value;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &signal_value;
+
+    VkSubmitInfo submit_info =
+        vk_boiler::submit_info(&frame->comp_cbuffer, &_target_sem,
+                               &signal_sem, &comp_stage_flags);
+    submit_info.pNext = &timeline_info;
+
+    if (_headless) {
+        submit_info.waitSemaphoreCount = 0;
+        timeline_info.waitSemaphoreValueCount = 0;
+    }
+
+    VK_CHECK(vkQueueSubmit(_comp_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    if (!_headless)
+        draw_present(frame);
+
+    _cpu_ms = (SDL_GetTicksNS() - cpu_begin) * (1.f / 1000000.f);
+}
+
+void vk_engine::draw_present(frame *frame)
+{
     /* wait and acquire the next frame */
     vkAcquireNextImageKHR(_device, _swapchain, UINT64_MAX, frame->present_sem,
                           VK_NULL_HANDLE, &_img_index);
 
-    /* prepare command buffer and dynamic rendering functions */
     VkCommandBufferBeginInfo cbuffer_begin_info =
         vk_boiler::cbuffer_begin_info();
 
-    /* begin command buffer recording */
-    VK_CHECK(vkBeginCommandBuffer(frame->cbuffer, &cbuffer_begin_info));
+    /* everything that still reads _target */
+    VK_CHECK(vkBeginCommandBuffer(frame->copy_cbuffer, &cbuffer_begin_info));
 
-    /* transition image format for rendering */
-    vk_cmd::vk_img_layout_transition(
-        frame->cbuffer, _target.img, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, _fam_index);
+    /* meshes whose uploads finished are drawn from here on */
+    _uploader.acquire(frame->copy_cbuffer);
 
-    draw_imgui();
+    if (_geometry.fragmented() && _uploader.done(_geometry.ticket))
+        _geometry.compact(frame->copy_cbuffer, _scheduler.current());
 
-    /* draw with comp */
-    draw_comp(frame);
+    /* acquire _target released at the end of draw_comp */
+    if (_async_compute)
+        vk_cmd::vk_img_ownership_transfer(
+            frame->copy_cbuffer, _target.img, VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, _comp_fam_index,
+            _fam_index);
 
     /* frame attachment info */
     VkRenderingAttachmentInfo color_attachment =
@@ -245,48 +362,113 @@ void vk_engine::draw()
     VkRenderingInfo rendering_info = vk_boiler::rendering_info(
         &color_attachment, &depth_attachment, _resolution);
 
-    vkCmdBeginRendering(frame->cbuffer, &rendering_info);
+    /* draw_nodes executes secondaries from the workers inside the scope */
+    if (_record_threads > 0)
+        rendering_info.flags =
+            VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+    vkCmdBeginRendering(frame->copy_cbuffer, &rendering_info);
 
     // draw_nodes(frame);
 
-    /* imgui rendering */
-    ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame->cbuffer);
+    vkCmdEndRendering(frame->copy_cbuffer);
 
-    vkCmdEndRendering(frame->cbuffer);
+    _profiler.begin(frame->copy_cbuffer, "swapchain copy");
 
     /* transition image format for transfering */
     vk_cmd::vk_img_layout_transition(
-        frame->cbuffer, _target.img, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        frame->copy_cbuffer, _target.img,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _fam_index);
 
     vk_cmd::vk_img_layout_transition(
-        frame->cbuffer, _swapchain_imgs[_img_index], VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _fam_index);
+        frame->copy_cbuffer, _swapchain_imgs[_img_index],
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        _fam_index);
+
+    /* upscale the rendered part of img to swapchain */
+    vk_cmd::vk_img_blit(frame->copy_cbuffer, _render_extent, _target.img,
+                        _window_extent, _swapchain_imgs[_img_index]);
+
+    _profiler.end(frame->copy_cbuffer);
+
+    VK_CHECK(vkEndCommandBuffer(frame->copy_cbuffer));
+
+    /* ui goes straight onto the swapchain so _target is free early */
+    VK_CHECK(vkBeginCommandBuffer(frame->cbuffer, &cbuffer_begin_info));
+
+    vk_cmd::vk_img_layout_transition(
+        frame->cbuffer, _swapchain_imgs[_img_index],
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, _fam_index);
+
+    VkRenderingAttachmentInfo swapchain_attachment =
+        vk_boiler::rendering_attachment_info(
+            _swapchain_img_views[_img_index],
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false, clear_value);
 
-    /* copy img to swapchain */
-    vk_cmd::vk_img_copy(
-        frame->cbuffer,
-        VkExtent3D{_window_extent.width, _window_extent.height, 1}, _target.img,
-        _swapchain_imgs[_img_index]);
+    VkRenderingInfo ui_rendering_info = vk_boiler::rendering_info(
+        &swapchain_attachment, nullptr, _window_extent);
+
+    vkCmdBeginRendering(frame->cbuffer, &ui_rendering_info);
+
+    /* imgui rendering */
+    ImGui::Render();
+    _profiler.begin(frame->cbuffer, "imgui");
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame->cbuffer);
+    _profiler.end(frame->cbuffer);
+
+    vkCmdEndRendering(frame->cbuffer);
 
     /* transition image format for presenting */
     vk_cmd::vk_img_layout_transition(
         frame->cbuffer, _swapchain_imgs[_img_index],
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        _fam_index);
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, _fam_index);
 
     VK_CHECK(vkEndCommandBuffer(frame->cbuffer));
 
-    /* submit present queue */
-    VkPipelineStageFlags pipeline_stage_flags =
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    /* the copy waits on the cloud pass and the acquire, then hands _target
+       back to the next frame's compute submit through _target_sem */
+    VkSemaphore copy_wait_sems[] = {frame->comp_sem, frame->present_sem};
+    VkPipelineStageFlags copy_wait_stages[] = {
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT};
+    uint64_t copy_wait_values[] = {0, 0};
+    uint64_t copy_signal_value = _scheduler.current();
+
+    VkTimelineSemaphoreSubmitInfo copy_timeline_info = {};
+    copy_timeline_info.sType =
+        VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    copy_timeline_info.pNext = nullptr;
+    copy_timeline_info.waitSemaphoreValueCount = 2;
+    copy_timeline_info.pWaitSemaphoreValues = copy_wait_values;
+    copy_timeline_info.signalSemaphoreValueCount = 1;
+    copy_timeline_info.pSignalSemaphoreValues = &copy_signal_value;
+
+    VkSubmitInfo copy_submit_info =
+        vk_boiler::submit_info(&frame->copy_cbuffer, copy_wait_sems,
+                               &_target_sem, copy_wait_stages);
+    copy_submit_info.pNext = &copy_timeline_info;
+    copy_submit_info.waitSemaphoreCount = 2;
+
+    /* binary semaphore for present, timeline value for frame retirement */
+    VkSemaphore signal_sems[] = {frame->sumbit_sem, _scheduler.timeline};
+    uint64_t signal_values[] = {0, _scheduler.current()};
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext = nullptr;
+    timeline_info.signalSemaphoreValueCount = 2;
+    timeline_info.pSignalSemaphoreValues = signal_values;
 
     VkSubmitInfo submit_info =
-        vk_boiler::submit_info(&frame->cbuffer, &frame->present_sem,
-                               &frame->sumbit_sem, &pipeline_stage_flags);
+        vk_boiler::submit_info(&frame->cbuffer, nullptr, signal_sems, nullptr);
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.signalSemaphoreCount = 2;
 
-    VK_CHECK(vkQueueSubmit(_queue, 1, &submit_info, frame->fence));
+    VkSubmitInfo submit_infos[] = {copy_submit_info, submit_info};
+    VK_CHECK(vkQueueSubmit(_queue, 2, submit_infos, VK_NULL_HANDLE));
 
     VkPresentInfoKHR present_info =
         vk_boiler::present_info(&_swapchain, &frame->sumbit_sem, &_img_index);
@@ -296,50 +478,100 @@ void vk_engine::draw()
 
 void vk_engine::draw_nodes(frame *frame)
 {
+    /* recorded inside the _target rendering scope of draw_present */
+    VkCommandBuffer cbuffer = frame->copy_cbuffer;
     std::vector<node> nodes(_nodes);
 
-    for (uint32_t i = 0; i < nodes.size(); ++i) {
-        node *node = &nodes[i];
-
-        for (auto c = node->children.cbegin(); c != node->children.cend(); ++c)
+    /* parents come before their children, resolve every transform first so
+       any range of nodes can be recorded on its own */
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+        for (auto c = nodes[i].children.cbegin(); c != nodes[i].children.cend();
+             ++c)
             nodes[*c].transform_mat =
-                node->transform_mat * nodes[*c].transform_mat;
+                nodes[i].transform_mat * nodes[*c].transform_mat;
 
-        if (node->mesh_id != -1) {
-            mesh *mesh = &_meshes[node->mesh_id];
-            vkCmdBindPipeline(frame->cbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              _gfx_pipeline);
+    if (_record_threads == 0) {
+        record_nodes(cbuffer, nodes, 0, nodes.size());
+        return;
+    }
+
+    /* a few chunks per thread evens out meshes of different sizes */
+    uint32_t chunk = std::max<uint32_t>(
+        64, (nodes.size() + _workers.size() * 4 - 1) / (_workers.size() * 4));
+
+    std::vector<record_job> jobs;
+    for (uint32_t begin = 0; begin < nodes.size(); begin += chunk) {
+        uint32_t end = std::min<uint32_t>(begin + chunk, nodes.size());
+        jobs.push_back([&, begin, end](VkCommandBuffer secondary) {
+            record_nodes(secondary, nodes, begin, end);
+        });
+    }
+
+    VkFormat depth_format = _depth_img.format;
+
+    VkCommandBufferInheritanceRenderingInfo inheritance_rendering_info = {};
+    inheritance_rendering_info.sType =
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    inheritance_rendering_info.pNext = nullptr;
+    inheritance_rendering_info.colorAttachmentCount = 1;
+    inheritance_rendering_info.pColorAttachmentFormats = &_format;
+    inheritance_rendering_info.depthAttachmentFormat = depth_format;
+    inheritance_rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-            VkDeviceSize offset = 0;
-            vkCmdBindVertexBuffers(frame->cbuffer, 0, 1,
-                                   &mesh->vertex_buffer.buffer, &offset);
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = &inheritance_rendering_info;
+
+    std::vector<VkCommandBuffer> secondaries = _workers.record(
+        _fam_index, &inheritance_info,
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, jobs);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cbuffer, secondaries.size(), secondaries.data());
+}
+
+void vk_engine::record_nodes(VkCommandBuffer cbuffer,
+                             const std::vector<node> &nodes, uint32_t begin,
+                             uint32_t end)
+{
+    if (begin == end)
+        return;
 
-            vkCmdBindIndexBuffer(frame->cbuffer, mesh->index_buffer.buffer, 0,
-                                 VK_INDEX_TYPE_UINT16);
+    /* every mesh lives in _geometry, bound once per command buffer */
+    vkCmdBindPipeline(cbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _gfx_pipeline);
+    _geometry.bind(cbuffer);
+
+    for (uint32_t i = begin; i < end; ++i) {
+        const node *node = &nodes[i];
+
+        if (node->mesh_id != -1 &&
+            _uploader.done(_meshes[node->mesh_id].ticket)) {
+            mesh *mesh = &_meshes[node->mesh_id];
+            const geometry_range &range = _geometry.range(mesh->geometry);
 
             render_mat mat;
-            mat.view = _vk_camera.get_view_mat();
-            mat.proj = _vk_camera.get_proj_mat();
+            mat.view = _render_camera.get_view_mat();
+            mat.proj = _render_camera.get_proj_mat();
             mat.proj[1][1] *= -1;
             mat.model = node->transform_mat;
 
-            void *data;
-            vmaMapMemory(_allocator, _render_mat_buffer.allocation, &data);
-            std::memcpy((char *)data +
-                            i * pad_uniform_buffer_size(sizeof(render_mat)),
-                        &mat, sizeof(render_mat));
-            vmaUnmapMemory(_allocator, _render_mat_buffer.allocation);
-
             std::vector<VkDescriptorSet> sets = {
                 _render_mat_set,
-                mesh->texture_set,
+                _comp_allocator.heap.set,
             };
-            uint32_t doffset = i * pad_uniform_buffer_size(sizeof(render_mat));
-            vkCmdBindDescriptorSets(
-                frame->cbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                _gfx_pipeline_layout, 0, sets.size(), sets.data(), 1, &doffset);
-
-            vkCmdDrawIndexed(frame->cbuffer, mesh->indices.size(), 1, 0, 0, 0);
+            uint32_t doffset =
+                _comp_allocator.push_uniform(&mat, sizeof(render_mat));
+            vkCmdBindDescriptorSets(cbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _gfx_pipeline_layout, 0, sets.size(),
+                                    sets.data(), 1, &doffset);
+
+            vkCmdPushConstants(cbuffer, _gfx_pipeline_layout,
+                               VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                               sizeof(uint32_t),
+                               &mesh->texture_buffer.sampled_index);
+
+            vkCmdDrawIndexed(cbuffer, range.index_count, 1, range.first_index,
+                             range.first_vertex, 0);
         }
     }
 }
@@ -348,17 +580,27 @@ void vk_engine::cleanup()
 {
     vkDeviceWaitIdle(_device);
 
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplSDL3_Shutdown();
-    ImGui::DestroyContext();
+    if (!_headless) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplSDL3_Shutdown();
+        ImGui::DestroyContext();
+    }
 
+    pipeline_cache.save();
     deletion_queue.flush();
 }
 
 void vk_engine::run()
 {
-    SDL_Event e;
-    bool bquit = false;
+    if (_bench_recording) {
+        run_bench_recording();
+        return;
+    }
+
+    if (_headless) {
+        run_headless();
+        return;
+    }
 
     // uint32_t triangles = 0;
     // for (uint32_t i = 0; i < _nodes.size(); ++i) {
@@ -370,67 +612,262 @@ void vk_engine::run()
 
     SDL_SetWindowRelativeMouseMode(_window, true);
 
-    auto input = std::async([&]() {
-        const bool *state = SDL_GetKeyboardState(NULL);
-        float ms = 0.f;
+    /* SDL wants events on the thread that created the window, so this thread
+       owns input and the camera, rendering moves to its own thread */
+    std::thread render([&]() {
+        uint64_t last_ui = SDL_GetTicksNS();
 
-        while (!bquit) {
-            ms = (SDL_GetTicksNS() - _last_frame) * (1.f / 1000000.f);
+        while (!_quit.load(std::memory_order_relaxed)) {
+            std::vector<SDL_Event> events;
+            {
+                std::lock_guard<std::mutex> lock(_ui_event_mutex);
+                events.swap(_ui_events);
+            }
 
-            if (SDL_GetWindowRelativeMouseMode(_window)) {
-                if (state[SDL_SCANCODE_W])
-                    _vk_camera.w(ms);
+            for (auto &e : events)
+                ImGui_ImplSDL3_ProcessEvent(&e);
 
-                if (state[SDL_SCANCODE_A])
-                    _vk_camera.a(ms);
+            /* what ImGui_ImplSDL3_NewFrame would query from SDL */
+            uint64_t now = SDL_GetTicksNS();
+            ImGuiIO &io = ImGui::GetIO();
+            io.DisplaySize =
+                ImVec2(_window_extent.width, _window_extent.height);
+            io.DisplayFramebufferScale = ImVec2(1.f, 1.f);
+            io.DeltaTime = std::max((now - last_ui) * (1.f / 1000000000.f),
+                                    1.f / 10000.f);
+            last_ui = now;
 
-                if (state[SDL_SCANCODE_S])
-                    _vk_camera.s(ms);
+            ImGui_ImplVulkan_NewFrame();
+            ImGui::NewFrame();
 
-                if (state[SDL_SCANCODE_D])
-                    _vk_camera.d(ms);
+            draw();
+        }
+    });
 
-                if (state[SDL_SCANCODE_SPACE])
-                    _vk_camera.space(ms);
+    const bool *state = SDL_GetKeyboardState(NULL);
+    _last_frame = SDL_GetTicksNS();
+
+    while (!_quit.load(std::memory_order_relaxed)) {
+        bool relative = SDL_GetWindowRelativeMouseMode(_window);
+        bool moving = relative && (state[SDL_SCANCODE_W] ||
+                                   state[SDL_SCANCODE_A] ||
+                                   state[SDL_SCANCODE_S] ||
+                                   state[SDL_SCANCODE_D] ||
+                                   state[SDL_SCANCODE_SPACE] ||
+                                   state[SDL_SCANCODE_LCTRL]);
+
+        /* sleep until something happens, tick at 250 hz while a movement key
+           is held */
+        SDL_Event e;
+        bool pending = SDL_WaitEventTimeout(&e, moving ? 4 : 100);
+
+        while (pending) {
+            if (e.type == SDL_EVENT_QUIT)
+                _quit = true;
+
+            if (e.type == SDL_EVENT_KEY_DOWN)
+                if (e.key.key == SDLK_ESCAPE)
+                    _quit = true;
+
+            if (e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_TAB) {
+                relative = !relative;
+                SDL_SetWindowRelativeMouseMode(_window, relative);
+            } else if (e.type == SDL_EVENT_MOUSE_MOTION && relative)
+                _vk_camera.motion(e.motion.xrel, e.motion.yrel);
+            else if (!relative) {
+                std::lock_guard<std::mutex> lock(_ui_event_mutex);
+                _ui_events.push_back(e);
+            }
 
-                if (state[SDL_SCANCODE_LCTRL])
-                    _vk_camera.ctrl(ms);
+            pending = SDL_PollEvent(&e);
+        }
 
-                float x, y;
-                SDL_GetRelativeMouseState(&x, &y);
-                _vk_camera.motion(x, y);
-            }
+        float ms = (SDL_GetTicksNS() - _last_frame) * (1.f / 1000000.f);
+        _last_frame = SDL_GetTicksNS();
 
-            while (SDL_PollEvent(&e) != 0) {
-                if (e.type == SDL_EVENT_QUIT)
-                    bquit = true;
-
-                if (e.type == SDL_EVENT_KEY_DOWN)
-                    if (e.key.key == SDLK_ESCAPE)
-                        bquit = true;
-
-                if (e.type == SDL_EVENT_KEY_DOWN) {
-                    if (e.key.key == SDLK_TAB) {
-                        if (SDL_GetWindowRelativeMouseMode(_window))
-                            SDL_SetWindowRelativeMouseMode(_window, false);
-                        else
-                            SDL_SetWindowRelativeMouseMode(_window, true);
-                    }
-                } else if (!SDL_GetWindowRelativeMouseMode(_window))
-                    ImGui_ImplSDL3_ProcessEvent(&e);
-            }
+        if (relative) {
+            if (state[SDL_SCANCODE_W])
+                _vk_camera.w(ms);
+
+            if (state[SDL_SCANCODE_A])
+                _vk_camera.a(ms);
+
+            if (state[SDL_SCANCODE_S])
+                _vk_camera.s(ms);
+
+            if (state[SDL_SCANCODE_D])
+                _vk_camera.d(ms);
+
+            if (state[SDL_SCANCODE_SPACE])
+                _vk_camera.space(ms);
 
-            _last_frame = SDL_GetTicksNS();
+            if (state[SDL_SCANCODE_LCTRL])
+                _vk_camera.ctrl(ms);
         }
-    });
 
-    while (!bquit) {
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplSDL3_NewFrame();
-        ImGui::NewFrame();
+        _camera_buffer.write(_vk_camera);
+    }
+
+    render.join();
+}
+
+void vk_engine::run_headless()
+{
+    std::vector<float> cpu_ms;
+    _profiler.history_size = std::max(_profiler.history_size, _headless_frames);
 
+    for (uint32_t i = 0; i < _headless_frames; ++i) {
         draw();
+        cpu_ms.push_back(_cpu_ms);
     }
+
+    vkDeviceWaitIdle(_device);
+
+    /* collect the frames still in flight, oldest first */
+    std::vector<query_frame *> in_flight;
+    for (uint32_t i = 0; i < _scheduler.frame_overlap; ++i)
+        in_flight.push_back(&_frames[i].queries);
+
+    std::sort(in_flight.begin(), in_flight.end(),
+              [](query_frame *a, query_frame *b) {
+                  return a->frame_number < b->frame_number;
+              });
+
+    for (auto queries : in_flight)
+        _profiler.collect(queries);
+
+    readback_target(_headless_output.c_str());
+
+    if (!_memory_output.empty())
+        _memory.dump_json(_memory_output.c_str());
+
+    float cpu_total = 0.f;
+    float gpu_total = 0.f;
+
+    std::cout << "frame,cpu_ms,gpu_ms" << std::endl;
+    for (const auto &[frame_number, frame_results] : _profiler.history) {
+        float gpu = _profiler.total_ms(frame_results);
+        float cpu = cpu_ms[frame_number - 1];
+        cpu_total += cpu;
+        gpu_total += gpu;
+        std::cout << frame_number << "," << cpu << "," << gpu << std::endl;
+    }
+
+    uint32_t count = std::max<size_t>(_profiler.history.size(), 1);
+    std::cout << "average over " << _profiler.history.size() << " frames at "
+              << _resolution.width << "x" << _resolution.height << ": cpu "
+              << cpu_total / count << " ms, gpu " << gpu_total / count << " ms"
+              << std::endl;
+    std::cout << (_adaptive_steps ? "adaptive" : "fixed") << " steps: "
+              << _march_steps_per_pixel << " per marched pixel" << std::endl;
+}
+
+void vk_engine::run_bench_recording()
+{
+    /* records the graph passes over and over into secondaries without
+       submitting, the cost of recording alone as threads are added */
+    constexpr uint32_t jobs_per_frame = 128;
+    constexpr uint32_t frames = 100;
+
+    /* records only read the frame's state, any number of them may run at
+       once. settled once, every pass records its full work */
+    update_comp();
+
+    const auto &records = _graph.records();
+    std::vector<record_job> jobs;
+    for (uint32_t i = 0; i < jobs_per_frame; ++i)
+        jobs.push_back([&, i](VkCommandBuffer cbuffer) {
+            _comp_allocator.bind(cbuffer);
+            records[i % records.size()](cbuffer);
+        });
+
+    /* compute work records outside any rendering scope */
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = nullptr;
+
+    uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    float single_ms = 0.f;
+
+    std::cout << "threads,ms_per_frame,speedup" << std::endl;
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        worker_pool workers;
+        workers.device = _device;
+        workers.init(threads, 1, {_comp_fam_index});
+
+        uint64_t begin = SDL_GetTicksNS();
+
+        for (uint32_t f = 0; f < frames; ++f) {
+            /* nothing is submitted, every frame may reuse slot 0 */
+            _comp_allocator.begin_frame(0);
+            workers.begin_frame(0);
+            workers.record(_comp_fam_index, &inheritance_info, 0, jobs);
+        }
+
+        float ms = (SDL_GetTicksNS() - begin) * (1.f / 1000000.f) / frames;
+        if (threads == 1)
+            single_ms = ms;
+
+        std::cout << threads << "," << ms << "," << single_ms / ms
+                  << std::endl;
+
+        /* the pools stay on deletion_queue until cleanup */
+        workers.shutdown();
+    }
+}
+
+void vk_engine::readback_target(const char *filename)
+{
+    allocated_buffer readback;
+    VkDeviceSize size = _resolution.width * _resolution.height * 4;
+
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, &readback);
+
+    immediate_draw(
+        [&](VkCommandBuffer cbuffer) {
+            vk_cmd::vk_img_layout_transition(
+                cbuffer, _target.img, VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _comp_fam_index);
+
+            VkBufferImageCopy region = vk_boiler::buffer_img_copy(
+                VkExtent3D{_resolution.width, _resolution.height, 1});
+
+            vkCmdCopyImageToBuffer(cbuffer, _target.img,
+                                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                   readback.buffer, 1, &region);
+
+            vk_cmd::vk_img_layout_transition(
+                cbuffer, _target.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_LAYOUT_GENERAL, _comp_fam_index);
+        },
+        _comp_queue);
+
+    std::ofstream f(filename, std::ios::binary);
+
+    if (!f.is_open()) {
+        std::cerr << "readback: failed to open " << filename << std::endl;
+        vmaDestroyBuffer(_allocator, readback.buffer, readback.allocation);
+        return;
+    }
+
+    void *data;
+    vmaMapMemory(_allocator, readback.allocation, &data);
+    vmaInvalidateAllocation(_allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+
+    /* binary ppm, _target is bgra */
+    f << "P6\n" << _resolution.width << " " << _resolution.height << "\n255\n";
+    unsigned char *bgra = (unsigned char *)data;
+    for (uint32_t i = 0; i < _resolution.width * _resolution.height; ++i) {
+        unsigned char rgb[3] = {bgra[i * 4 + 2], bgra[i * 4 + 1], bgra[i * 4]};
+        f.write((char *)rgb, 3);
+    }
+
+    vmaUnmapMemory(_allocator, readback.allocation);
+    vmaDestroyBuffer(_allocator, readback.buffer, readback.allocation);
+    f.close();
+
+    std::cout << "final frame written to " << filename << std::endl;
 }
 
 void vk_engine::imgui_init()
@@ -448,7 +885,7 @@ void vk_engine::imgui_init()
     // rendering_info.viewMask = ;
     rendering_info.colorAttachmentCount = 1;
     rendering_info.pColorAttachmentFormats = &_format;
-    rendering_info.depthAttachmentFormat = _depth_img.format;
+    rendering_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
     // rendering_info.stencilAttachmentFormat = ;
 
     /* Setup Platform/Renderer backends */
@@ -465,7 +902,12 @@ void vk_engine::imgui_init()
     imgui_init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     imgui_init_info.UseDynamicRendering = true;
     imgui_init_info.PipelineRenderingCreateInfo = rendering_info;
+    imgui_init_info.PipelineCache = pipeline_cache.cache;
+
+    /* builds its pipeline */
+    uint64_t begin = SDL_GetTicksNS();
     ImGui_ImplVulkan_Init(&imgui_init_info);
+    pipeline_cache.add_time((SDL_GetTicksNS() - begin) * (1.f / 1000000.f));
     ImGui_ImplVulkan_CreateFontsTexture();
     ImGui_ImplVulkan_DestroyFontsTexture();
 
@@ -501,7 +943,7 @@ void vk_engine::imgui_init()
 void vk_engine::draw_imgui()
 {
     ImGui::Begin("cloud", &cloud_ui, ImGuiWindowFlags_NoResize);
-    ImGui::SetWindowSize(ImVec2(290.f, 290.f));
+    ImGui::SetWindowSize(ImVec2(290.f, _noise_reference ? 386.f : 362.f));
     ImGui::Text("'tab' to toggle; 'ese' to close");
     ImGui::Text("application average %.3f ms/frame \n (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
@@ -511,10 +953,75 @@ void vk_engine::draw_imgui()
     ImGui::SliderFloat("sigma_a", &_cloud_data.sigma_a, 0.f, 1.f);
     ImGui::SliderFloat("sigma_s", &_cloud_data.sigma_s, 0.f, 1.f);
     ImGui::SliderFloat("step", &_cloud_data.step, .1f, 2.f);
-    ImGui::SliderInt("max_steps", &_cloud_data.max_steps, 0, 128);
     ImGui::SliderFloat("cutoff", &_cloud_data.cutoff, 0.f, 1.f);
     ImGui::SliderFloat("density", &_cloud_data.density, 0.f, 3.f);
     ImGui::ColorEdit3("sun_color", (float *)&_cloud_data.sun_color);
     ImGui::ColorEdit3("sky_color", (float *)&_cloud_data.sky_color);
+
+    /* kept normalized, a zero vector is ignored */
+    glm::vec3 sun_dir = _cloud_data.sun_dir;
+    if (ImGui::SliderFloat3("sun_dir", &sun_dir.x, -1.f, 1.f) &&
+        glm::length(sun_dir) > .01f)
+        _cloud_data.sun_dir = glm::normalize(sun_dir);
+
+    /* block is 1 << mode, march 1, 1/4 or 1/16 of the pixels */
+    const char *temporal_modes[] = {"off", "1/4", "1/16"};
+    int temporal_mode =
+        _temporal_data.block == 4 ? 2 : _temporal_data.block - 1;
+    if (ImGui::Combo("temporal", &temporal_mode, temporal_modes, 3)) {
+        _temporal_data.block = 1 << temporal_mode;
+        _temporal_data.reset = 1;
+    }
+
+    /* every preset is built, the next frame binds another pipeline */
+    int quality = _cloud_quality;
+    if (ImGui::Combo("quality", &quality, CLOUD_QUALITY_NAMES,
+                     CLOUD_QUALITY_COUNT))
+        _cloud_quality = quality;
+
+    /* only with the reference volume, see --noise */
+    int noise = _noise_mode;
+    if (_noise_reference &&
+        ImGui::Combo("noise", &noise, NOISE_MODE_NAMES, NOISE_MODE_COUNT)) {
+        _noise_mode = noise;
+        _temporal_data.reset = 1;
+    }
+
+    if (ImGui::Checkbox("adaptive steps", &_adaptive_steps))
+        _temporal_data.reset = 1;
+    ImGui::End();
+
+    ImGui::Begin("profiler", &profiler_ui, ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Text("gpu frame %llu", (unsigned long long)_profiler.results_frame);
+    for (const auto &result : _profiler.results)
+        ImGui::Text("%-16s %.3f ms", result.name.c_str(), result.ms);
+    ImGui::Text("%-16s %.3f ms", "total", _profiler.total_ms());
+    ImGui::Text("%-16s %u", "graph barriers", _graph.barrier_count);
+    ImGui::Text("%-16s %.1f", "march steps/px", _march_steps_per_pixel);
+    ImGui::Text("%-16s %u", "marched pixels", _march_pixels);
+    ImGui::Checkbox("dynamic resolution", &_drs.enabled);
+    ImGui::SliderFloat("budget ms", &_drs.budget_ms, 1.f, 33.f);
+    ImGui::Text("%-16s %ux%u", "resolution", _render_extent.width,
+                _render_extent.height);
+    if (ImGui::Button("export csv"))
+        _profiler.export_csv("profiler.csv");
+
+    if (ImGui::CollapsingHeader("memory")) {
+        ImGui::Text("%-16s %s", "memory budget",
+                    _memory.memory_budget ? "reported" : "estimated");
+
+        for (const auto &h : _memory.heaps())
+            ImGui::Text("heap %u%-9s %7.1f / %7.1f MB (vma %.1f MB)", h.heap,
+                        h.device_local ? " device" : "", h.usage / 1048576.f,
+                        h.budget / 1048576.f, h.block_bytes / 1048576.f);
+
+        ImGui::Separator();
+        for (const auto &r : _memory.resource_sizes())
+            ImGui::Text("%-16s %-6s %7.2f MB", r.name.c_str(), r.kind,
+                        r.bytes / 1048576.f);
+
+        if (ImGui::Button("dump json"))
+            _memory.dump_json("memory.json");
+    }
     ImGui::End();
 }
@@ -1,24 +1,34 @@
 ﻿#pragma once
 
+#include <atomic>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <volk.h>
 
 #include "vk_mem_alloc.h"
+#include <SDL3/SDL_events.h>
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
 #include "vk_camera.h"
 #include "vk_comp.h"
+#include "vk_drs.h"
+#include "vk_frame.h"
+#include "vk_geometry.h"
+#include "vk_graph.h"
+#include "vk_memory.h"
 #include "vk_mesh.h"
+#include "vk_profiler.h"
 #include "vk_type.h"
-
-constexpr int FRAME_OVERLAP = 2;
+#include "vk_upload.h"
+#include "vk_workers.h"
 
 struct frame {
-    VkFence fence;
-    VkSemaphore sumbit_sem, present_sem;
-    VkCommandPool cpool;
-    VkCommandBuffer cbuffer;
+    VkSemaphore sumbit_sem, present_sem, comp_sem;
+    VkCommandPool cpool, comp_cpool;
+    VkCommandBuffer cbuffer, copy_cbuffer, comp_cbuffer;
+    query_frame queries;
 };
 
 struct immed_context {
@@ -54,11 +64,160 @@ struct cloud_data {
     float sigma_a;
     float sigma_s;
     float step;
-    int max_steps;
+    /* std430 keeps sun_color at 32 bytes */
+    float pad;
     float cutoff;
     glm::vec3 sun_color;
     float density;
     glm::vec3 sky_color;
+    /* std430 keeps sun_dir at 64 bytes */
+    float pad1;
+    /* towards the sun, normalized */
+    glm::vec3 sun_dir;
+    float pad2;
+};
+
+/* which noise cloud.comp samples: the 8 bit shape and detail volumes, the
+   16 bit layout they replace, or the reference on the left half and the
+   compact one on the right */
+constexpr uint32_t NOISE_MODE_COUNT = 3;
+
+constexpr const char *NOISE_MODE_NAMES[NOISE_MODE_COUNT] = {
+    "compact", "reference", "split"};
+
+/* specialization constants of cloud.comp, in constant_id order. every
+   preset is built up front, switching is only a different bind */
+struct cloud_quality {
+    int32_t max_steps;
+    /* taps towards the sun per texel of the light volume, a push constant of
+       light.comp rather than a specialization constant */
+    int32_t light_steps;
+    /* the march stops below this transmittance */
+    float min_transmittance;
+    /* fine steps one coarse step over empty space spans */
+    float skip;
+    /* henyey-greenstein lobes in the phase function, 1 to 4 */
+    int32_t phase_lobes;
+};
+
+constexpr uint32_t CLOUD_QUALITY_COUNT = 4;
+
+constexpr const char *CLOUD_QUALITY_NAMES[CLOUD_QUALITY_COUNT] = {
+    "low", "medium", "high", "ultra"};
+
+constexpr cloud_quality CLOUD_QUALITIES[CLOUD_QUALITY_COUNT] = {
+    {32, 2, .7f, 24.f, 1},
+    {48, 4, .65f, 20.f, 2},
+    {64, 6, .6f, 16.f, 4},
+    {128, 8, .4f, 8.f, 4},
+};
+
+/* cloud.comp marches one pixel of every block x block per frame and
+   reprojects the rest from history */
+struct temporal_data {
+    uint32_t frame;
+    uint32_t block;
+    uint32_t reset;
+};
+
+/* push constants of the compute shaders, images are bindless heap indices
+   and uniforms byte offsets into the ring at heap index uniforms */
+struct weather_push {
+    float time;
+    uint32_t target;
+};
+
+/* reference is BINDLESS_NONE unless the 16 bit layout is kept */
+struct cloudtex_push {
+    uint32_t shape;
+    uint32_t detail;
+    uint32_t reference;
+};
+
+/* formats downsample.comp handles */
+constexpr uint32_t DOWNSAMPLE_R8_2D = 0;
+constexpr uint32_t DOWNSAMPLE_R8_3D = 1;
+constexpr uint32_t DOWNSAMPLE_RGBA16F_3D = 2;
+
+struct downsample_push {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t format;
+};
+
+struct cloudtex_max_push {
+    uint32_t cloudtex;
+    uint32_t detail;
+    uint32_t reference;
+    uint32_t target;
+    uint32_t level;
+};
+
+/* the grid of shaders/cloud.glsl, its levels stacked along z */
+constexpr VkExtent3D OCCUPANCY_EXTENT = {64, 32, 112};
+constexpr uint32_t OCCUPANCY_LEVELS = 3;
+
+/* weather.comp scrolls the map this many texels per unit of u_time. the grid
+   bounds the next OCCUPANCY_DRIFT texels of it, and is rebuilt once they have
+   passed */
+constexpr float WEATHER_SPEED = 128.f;
+constexpr uint32_t OCCUPANCY_DRIFT = 8;
+
+struct occupancy_push {
+    uint32_t target;
+    uint32_t level;
+    uint32_t weather;
+    uint32_t cloudtex_max;
+    uint32_t uniforms;
+    uint32_t cloud;
+    uint32_t drift;
+};
+
+/* the sun's optical depth over the occupancy grid's box, baked
+   LIGHT_EXTENT.depth / LIGHT_SLICES slices a frame */
+constexpr VkExtent3D LIGHT_EXTENT = {128, 64, 128};
+constexpr uint32_t LIGHT_SLICES = 4;
+
+struct light_push {
+    uint32_t target;
+    uint32_t first;
+    uint32_t steps;
+    uint32_t weather;
+    uint32_t cloudtex;
+    uint32_t detail;
+    uint32_t uniforms;
+    uint32_t cloud;
+};
+
+struct cloud_push {
+    temporal_data temporal;
+    uint32_t target;
+    uint32_t cloudtex;
+    uint32_t weather;
+    uint32_t history0;
+    uint32_t history1;
+    uint32_t uniforms;
+    uint32_t camera;
+    uint32_t cloud;
+    uint32_t prev_camera;
+    uint32_t occupancy;
+    uint32_t detail;
+    uint32_t reference;
+    uint32_t noise;
+    uint32_t light;
+    uint32_t blue_noise;
+    uint32_t stats;
+    uint32_t stats_slot;
+    uint32_t adaptive;
+};
+
+/* tile of blue noise jittering the start of each ray */
+constexpr uint32_t BLUE_NOISE_SIZE = 64;
+
+/* what cloud.comp counted in one frame's slot of "march_stats" */
+struct march_stats {
+    uint32_t steps;
+    uint32_t pixels;
 };
 
 class vk_engine
@@ -66,37 +225,125 @@ class vk_engine
 public:
     // data used every frame
     vk_camera _vk_camera;
+
+    /* _vk_camera is simulated on the main thread, the render thread records
+       each frame from one snapshot */
+    triple_buffer<vk_camera> _camera_buffer;
+    vk_camera _render_camera;
     float u_time = 0.f;
 
     uint32_t _frame_index = 0;
+    frame_scheduler _scheduler;
     cloud_data _cloud_data;
 
+    /* one cloud.comp pipeline per CLOUD_QUALITIES, _cloud_quality indexes
+       both */
+    VkPipeline _cloud_pipelines[CLOUD_QUALITY_COUNT];
+    uint32_t _cloud_quality = 2;
+
+    /* NOISE_MODE_NAMES, the reference volume only exists when this is not
+       compact at startup */
+    uint32_t _noise_mode = 0;
+    bool _noise_reference = false;
+
+    /* fills the mip levels of cloudtex and weather, see downsample */
+    VkPipeline _downsample_pipeline;
+
+    /* what the occupancy grid was last built from, the drift window is
+       u_time in steps of OCCUPANCY_DRIFT weather texels */
+    float _occupancy_window = -1.f;
+    cloud_data _occupancy_cloud = {};
+    bool _occupancy_rebuild = false;
+
+    /* coarse steps over empty space and back to the last of them on the
+       first hit, instead of fixed steps only */
+    bool _adaptive_steps = true;
+
+    /* one slot per frame in flight, mapped. draw reads a slot back and
+       clears it once the frame that wrote it has retired */
+    buffer_handle _march_stats_buffer;
+    march_stats *_march_stats = nullptr;
+    float _march_steps_per_pixel = 0.f;
+    uint32_t _march_pixels = 0;
+
+    /* what the light volume is being baked from and the next slice to bake.
+       this frame bakes _light_count slices from _light_first */
+    cloud_data _light_cloud = {};
+    uint32_t _light_quality = UINT32_MAX;
+    uint32_t _light_slice = 0;
+    uint32_t _light_first = 0;
+    uint32_t _light_count = 0;
+
     camera_data _camera_data;
+    camera_data _prev_camera_data;
+    temporal_data _temporal_data = {0, 2, 1};
     VkDevice _device;
     struct SDL_Window *_window = nullptr;
 
-    frame _frames[FRAME_OVERLAP];
+    frame _frames[MAX_FRAME_OVERLAP];
 
-    std::vector<std::function<void(VkCommandBuffer)>> cs_draw;
+    render_graph _graph;
     std::vector<VkImage> _swapchain_imgs;
 
     VkSwapchainKHR _swapchain;
     allocated_img _target;
     uint64_t _last_frame = 0;
+    std::atomic<bool> _quit{false};
+
+    /* ui events, gathered on the main thread and fed to imgui on the render
+       thread */
+    std::mutex _ui_event_mutex;
+    std::vector<SDL_Event> _ui_events;
     uint32_t _img_index;
     uint32_t _fam_index = 0;
 
+    /* _graph runs on a dedicated compute queue when the device has one */
+    bool _async_compute = true;
+    VkQueue _comp_queue;
+    uint32_t _comp_fam_index = 0;
+    VkSemaphore _target_sem;
+
+    /* meshes and textures stream in through _uploader, on a transfer only
+       queue when the device has one and on _queue otherwise */
+    VkQueue _transfer_queue;
+    uint32_t _transfer_fam_index = 0;
+    uploader _uploader;
+
+    /* graph passes and node chunks record into secondaries on this many
+       threads, 0 records everything on the render thread */
+    uint32_t _record_threads = 0;
+    worker_pool _workers;
+
     VkFormat _format = {VK_FORMAT_B8G8R8A8_UNORM};
     VkColorSpaceKHR _colorspace = {VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
     allocated_img _depth_img;
     VkQueue _queue;
     VmaAllocator _allocator;
 
+    /* render offscreen into _target only, no window or swapchain */
+    bool _headless = false;
+    uint32_t _headless_frames = 100;
+    std::string _headless_output = "headless.ppm";
+    float _cpu_ms = 0.f;
+
+    /* written after a headless run when set */
+    std::string _memory_output;
+
+    /* time recording the graph on 1, 2, 4... threads instead of drawing */
+    bool _bench_recording = false;
+
     bool cloud_ui = true;
+    bool profiler_ui = true;
     comp_allocator _comp_allocator;
+    gpu_profiler _profiler;
+    memory_stats _memory;
     VkExtent2D _window_extent = {1024, 768};
     VkExtent2D _resolution = {1024, 768};
 
+    /* the clouds render into the top left _render_extent of _target */
+    drs_controller _drs;
+    VkExtent2D _render_extent = {1024, 768};
+
     VkPipeline _gfx_pipeline;
     VkPipelineLayout _gfx_pipeline_layout;
 
@@ -112,16 +359,16 @@ public:
     VkDescriptorPool _descriptor_pool;
     VkDescriptorSetLayout _render_mat_layout;
     VkDescriptorSet _render_mat_set;
-    allocated_buffer _render_mat_buffer;
-    VkDescriptorSetLayout _texture_layout;
 
     std::vector<mesh> _meshes;
+    geometry_arena _geometry;
     std::vector<node> _nodes;
 
     VkShaderModule _vert;
     VkShaderModule _frag;
 
     immed_context _immed_context;
+    immed_context _comp_immed_context;
 
     void immediate_draw(std::function<void(VkCommandBuffer cmd)> &&fs,
                         VkQueue queue);
@@ -139,11 +386,11 @@ private:
     void device_init();
     void vma_init();
     void swapchain_init();
+    void target_init();
     void command_init();
     void sync_init();
 
     void descriptor_init();
-    VkShaderModule load_shader_module(const char *file);
     void pipeline_init();
 
     void imgui_init();
@@ -153,17 +400,35 @@ private:
     void upload_textures(mesh *meshes, size_t size);
 
     void comp_init();
+    void downsample_init();
+    /* every level below mip 0 of an r8 2d image or an r8 or rgba16f volume,
+       in GENERAL. level 0 must be visible to compute shaders */
+    void downsample(VkCommandBuffer cbuffer, img_handle id);
     void cloudtex_init();
+    void cloudtex_max_init();
     void weather_init();
+    void occupancy_init();
+    void light_init();
+    void blue_noise_init();
     void cloud_init();
 
+    void run_headless();
+    void run_bench_recording();
+    void readback_target(const char *filename);
+
     void draw_imgui();
+    /* settles the state the passes read this frame, a pass may be recorded
+       on any worker or more than once and only reads it */
+    void update_comp();
     void draw_comp(frame *frame);
     void draw_nodes(frame *frame);
+    void record_nodes(VkCommandBuffer cbuffer, const std::vector<node> &nodes,
+                      uint32_t begin, uint32_t end);
+    void draw_present(frame *frame);
 
     inline frame *get_current_frame()
     {
-        _frame_index = !_frame_index;
+        _frame_index = _scheduler.begin_frame();
         return &_frames[_frame_index];
     };
 
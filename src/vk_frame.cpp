@@ -0,0 +1,46 @@
+#include "vk_frame.h"
+
+#include "vk_boiler.h"
+#include "vk_type.h"
+
+void frame_scheduler::init()
+{
+    VkSemaphoreTypeCreateInfo sem_type_info =
+        vk_boiler::sem_type_create_info(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+
+    VkSemaphoreCreateInfo sem_info = vk_boiler::sem_create_info();
+    sem_info.pNext = &sem_type_info;
+
+    VK_CHECK(vkCreateSemaphore(device, &sem_info, nullptr, &timeline));
+
+    deletion_queue.push(timeline);
+}
+
+uint32_t frame_scheduler::begin_frame()
+{
+    ++frame_number;
+
+    if (frame_number > frame_overlap)
+        wait(frame_number - frame_overlap);
+
+    return frame_number % frame_overlap;
+}
+
+uint64_t frame_scheduler::completed()
+{
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &value));
+    return value;
+}
+
+void frame_scheduler::wait(uint64_t value)
+{
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.pNext = nullptr;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline;
+    wait_info.pValues = &value;
+
+    VK_CHECK(vkWaitSemaphores(device, &wait_info, UINT64_MAX));
+}
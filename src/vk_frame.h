@@ -0,0 +1,29 @@
+#pragma once
+
+#include <volk.h>
+
+constexpr uint32_t MAX_FRAME_OVERLAP = 4;
+
+/* frames are numbered from 1, the timeline reaches n once frame n has retired
+   on the gpu, other subsystems can key work off those values */
+struct frame_scheduler {
+public:
+    VkDevice device;
+    VkSemaphore timeline;
+
+    /* frames in flight, 1 to MAX_FRAME_OVERLAP */
+    uint32_t frame_overlap = 2;
+
+    void init();
+
+    /* start the next frame, blocks until the frame that last used its slot
+       has retired and returns the slot */
+    uint32_t begin_frame();
+
+    inline uint64_t current() { return frame_number; };
+    uint64_t completed();
+    void wait(uint64_t value);
+
+private:
+    uint64_t frame_number = 0;
+};
@@ -0,0 +1,251 @@
+#include "vk_geometry.h"
+
+#include <algorithm>
+#include <iostream>
+
+void geometry_arena::init(uint32_t vertices, uint32_t indices)
+{
+    vertex_capacity = vertices;
+    index_capacity = indices;
+
+    create(&vertex_buffer, (VkDeviceSize)vertex_capacity * sizeof(vertex),
+           VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vertex_block,
+           "geometry vertices");
+    create(&index_buffer, (VkDeviceSize)index_capacity * sizeof(uint16_t),
+           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &index_block, "geometry indices");
+
+    /* whichever buffers are current by then, compaction retires the rest */
+    deletion_queue.push_back([=, this]() {
+        vmaDestroyBuffer(allocator, vertex_buffer.buffer,
+                         vertex_buffer.allocation);
+        vmaDestroyBuffer(allocator, index_buffer.buffer,
+                         index_buffer.allocation);
+        destroy_blocks();
+    });
+}
+
+geometry_id geometry_arena::add(const std::vector<vertex> &vertices,
+                                const std::vector<uint16_t> &indices)
+{
+    VkDeviceSize vertex_size = vertices.size() * sizeof(vertex);
+    VkDeviceSize index_size = indices.size() * sizeof(uint16_t);
+
+    slot s = {};
+    s.used = true;
+
+    VkDeviceSize vertex_offset, index_offset;
+    bool fits = allocate(vertex_block, vertex_size, sizeof(vertex),
+                         &s.vertex_alloc, &vertex_offset);
+
+    if (fits && !allocate(index_block, index_size, sizeof(uint16_t),
+                          &s.index_alloc, &index_offset)) {
+        vmaVirtualFree(vertex_block, s.vertex_alloc);
+        fits = false;
+    }
+
+    if (!fits) {
+        std::cerr << "geometry arena: out of space for " << vertices.size()
+                  << " vertices and " << indices.size() << " indices"
+                  << std::endl;
+        abort();
+    }
+
+    s.range.first_vertex = vertex_offset / sizeof(vertex);
+    s.range.vertex_count = vertices.size();
+    s.range.first_index = index_offset / sizeof(uint16_t);
+    s.range.index_count = indices.size();
+
+    allocated_bytes += vertex_size + index_size;
+
+    if (vertex_size > 0)
+        ticket = std::max(ticket, uploads->upload_buffer(
+                                      vertices.data(), vertex_size,
+                                      vertex_buffer, vertex_offset));
+    if (index_size > 0)
+        ticket = std::max(ticket,
+                          uploads->upload_buffer(indices.data(), index_size,
+                                                 index_buffer, index_offset));
+
+    geometry_id id;
+    if (free_slots.empty()) {
+        id = slots.size();
+        slots.push_back(s);
+    } else {
+        id = free_slots.back();
+        free_slots.pop_back();
+        slots[id] = s;
+    }
+
+    return id;
+}
+
+void geometry_arena::remove(geometry_id id, uint64_t frame)
+{
+    slot &s = slots[id];
+
+    retired.push_back({s.vertex_alloc, s.index_alloc, frame});
+    freed_bytes += (VkDeviceSize)s.range.vertex_count * sizeof(vertex) +
+                   (VkDeviceSize)s.range.index_count * sizeof(uint16_t);
+
+    s.used = false;
+    free_slots.push_back(id);
+}
+
+void geometry_arena::collect(uint64_t completed_frame)
+{
+    auto live = std::stable_partition(
+        retired.begin(), retired.end(),
+        [=](const retired_range &r) { return r.frame <= completed_frame; });
+
+    for (auto r = retired.begin(); r != live; ++r) {
+        vmaVirtualFree(vertex_block, r->vertex_alloc);
+        vmaVirtualFree(index_block, r->index_alloc);
+    }
+
+    retired.erase(retired.begin(), live);
+}
+
+void geometry_arena::bind(VkCommandBuffer cbuffer)
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cbuffer, 0, 1, &vertex_buffer.buffer, &offset);
+    vkCmdBindIndexBuffer(cbuffer, index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+void geometry_arena::compact(VkCommandBuffer cbuffer, uint64_t frame)
+{
+    allocated_buffer old_vertex_buffer = vertex_buffer;
+    allocated_buffer old_index_buffer = index_buffer;
+
+    /* ranges waiting to retire are dropped with the old blocks */
+    destroy_blocks();
+    retired.clear();
+
+    create(&vertex_buffer, (VkDeviceSize)vertex_capacity * sizeof(vertex),
+           VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vertex_block,
+           "geometry vertices");
+    create(&index_buffer, (VkDeviceSize)index_capacity * sizeof(uint16_t),
+           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &index_block, "geometry indices");
+
+    std::vector<VkBufferCopy> vertex_regions;
+    std::vector<VkBufferCopy> index_regions;
+    allocated_bytes = 0;
+    freed_bytes = 0;
+
+    /* a fresh block hands out space front to back */
+    for (auto &s : slots) {
+        if (!s.used)
+            continue;
+
+        VkDeviceSize vertex_size = s.range.vertex_count * sizeof(vertex);
+        VkDeviceSize index_size = s.range.index_count * sizeof(uint16_t);
+        VkDeviceSize vertex_offset, index_offset;
+
+        allocate(vertex_block, vertex_size, sizeof(vertex), &s.vertex_alloc,
+                 &vertex_offset);
+        allocate(index_block, index_size, sizeof(uint16_t), &s.index_alloc,
+                 &index_offset);
+
+        if (vertex_size > 0)
+            vertex_regions.push_back({s.range.first_vertex * sizeof(vertex),
+                                      vertex_offset, vertex_size});
+        if (index_size > 0)
+            index_regions.push_back({s.range.first_index * sizeof(uint16_t),
+                                     index_offset, index_size});
+
+        s.range.first_vertex = vertex_offset / sizeof(vertex);
+        s.range.first_index = index_offset / sizeof(uint16_t);
+        allocated_bytes += vertex_size + index_size;
+    }
+
+    if (!vertex_regions.empty())
+        vkCmdCopyBuffer(cbuffer, old_vertex_buffer.buffer, vertex_buffer.buffer,
+                        vertex_regions.size(), vertex_regions.data());
+    if (!index_regions.empty())
+        vkCmdCopyBuffer(cbuffer, old_index_buffer.buffer, index_buffer.buffer,
+                        index_regions.size(), index_regions.data());
+
+    VkMemoryBarrier2 mem_barrier = {};
+    mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    mem_barrier.pNext = nullptr;
+    mem_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    mem_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    mem_barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+    mem_barrier.dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT |
+                                VK_ACCESS_2_INDEX_READ_BIT;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &mem_barrier;
+
+    vkCmdPipelineBarrier2(cbuffer, &dependency_info);
+
+    deletion_queue.retire(old_vertex_buffer, frame);
+    deletion_queue.retire(old_index_buffer, frame);
+}
+
+void geometry_arena::create(allocated_buffer *buffer, VkDeviceSize size,
+                            VkBufferUsageFlags usage, VmaVirtualBlock *block,
+                            const char *name)
+{
+    VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = size;
+    /* compaction copies out of the old buffers */
+    buffer_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    /* written in place when vma finds host visible device local memory,
+       copied through the staging ring otherwise */
+    VmaAllocationCreateInfo vma_allocation_info = {};
+    vma_allocation_info.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+    vma_allocation_info.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &vma_allocation_info,
+                             &buffer->buffer, &buffer->allocation, nullptr));
+    vmaSetAllocationName(allocator, buffer->allocation, name);
+
+    buffer->size = size;
+
+    VmaVirtualBlockCreateInfo block_info = {};
+    block_info.size = size;
+    VK_CHECK(vmaCreateVirtualBlock(&block_info, block));
+}
+
+bool geometry_arena::allocate(VmaVirtualBlock block, VkDeviceSize size,
+                              VkDeviceSize alignment,
+                              VmaVirtualAllocation *allocation,
+                              VkDeviceSize *offset)
+{
+    /* vma refuses zero sizes, an empty range takes no space. freeing the
+       null allocation is a no-op */
+    if (size == 0) {
+        *allocation = VK_NULL_HANDLE;
+        *offset = 0;
+        return true;
+    }
+
+    VmaVirtualAllocationCreateInfo allocation_info = {};
+    allocation_info.size = size;
+    allocation_info.alignment = alignment;
+
+    return vmaVirtualAllocate(block, &allocation_info, allocation, offset) ==
+           VK_SUCCESS;
+}
+
+void geometry_arena::destroy_blocks()
+{
+    for (VmaVirtualBlock block : {vertex_block, index_block}) {
+        if (block == VK_NULL_HANDLE)
+            continue;
+
+        vmaClearVirtualBlock(block);
+        vmaDestroyVirtualBlock(block);
+    }
+
+    vertex_block = VK_NULL_HANDLE;
+    index_block = VK_NULL_HANDLE;
+}
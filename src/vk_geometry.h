@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <volk.h>
+
+#include "vk_mem_alloc.h"
+
+#include "vk_mesh.h"
+#include "vk_type.h"
+#include "vk_upload.h"
+
+constexpr uint32_t GEOMETRY_MIN_VERTICES = 1 << 20;
+constexpr uint32_t GEOMETRY_MIN_INDICES = 1 << 22;
+
+/* where a mesh lives in the arena, in vertices and indices, indices are
+   relative to first_vertex */
+struct geometry_range {
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+};
+
+/* index of a range, stays valid across compaction */
+typedef uint32_t geometry_id;
+
+/* one vertex buffer and one index buffer every mesh is sub-allocated from,
+   bound once per command buffer. space is managed by vma virtual blocks */
+struct geometry_arena {
+public:
+    VkDevice device;
+    VmaAllocator allocator;
+    uploader *uploads;
+
+    allocated_buffer vertex_buffer = {};
+    allocated_buffer index_buffer = {};
+
+    /* the latest upload into the arena, compact waits for it */
+    upload_ticket ticket = 0;
+
+    void init(uint32_t vertices, uint32_t indices);
+
+    /* upload through uploads, ticket covers it. either may be empty */
+    geometry_id add(const std::vector<vertex> &vertices,
+                    const std::vector<uint16_t> &indices);
+
+    inline const geometry_range &range(geometry_id id)
+    {
+        return slots[id].range;
+    };
+
+    /* the space is reused once frame, the last one drawing it, retired */
+    void remove(geometry_id id, uint64_t frame);
+    void collect(uint64_t completed_frame);
+
+    void bind(VkCommandBuffer cbuffer);
+
+    /* more than half of what was allocated since the last compaction has
+       been freed again */
+    inline bool fragmented() { return freed_bytes * 2 > allocated_bytes; };
+
+    /* copy every live range to the front of new buffers, recorded into
+       cbuffer outside any rendering scope, the old buffers retire with
+       frame. uploads into the arena must be acquired already */
+    void compact(VkCommandBuffer cbuffer, uint64_t frame);
+
+private:
+    struct slot {
+        geometry_range range;
+        VmaVirtualAllocation vertex_alloc;
+        VmaVirtualAllocation index_alloc;
+        bool used;
+    };
+
+    struct retired_range {
+        VmaVirtualAllocation vertex_alloc;
+        VmaVirtualAllocation index_alloc;
+        uint64_t frame;
+    };
+
+    uint32_t vertex_capacity;
+    uint32_t index_capacity;
+    VmaVirtualBlock vertex_block = VK_NULL_HANDLE;
+    VmaVirtualBlock index_block = VK_NULL_HANDLE;
+
+    std::vector<slot> slots;
+    std::vector<geometry_id> free_slots;
+    std::vector<retired_range> retired;
+
+    VkDeviceSize allocated_bytes = 0;
+    VkDeviceSize freed_bytes = 0;
+
+    void create(allocated_buffer *buffer, VkDeviceSize size,
+                VkBufferUsageFlags usage, VmaVirtualBlock *block,
+                const char *name);
+    bool allocate(VmaVirtualBlock block, VkDeviceSize size,
+                  VkDeviceSize alignment, VmaVirtualAllocation *allocation,
+                  VkDeviceSize *offset);
+    void destroy_blocks();
+};
@@ -0,0 +1,325 @@
+#include "vk_graph.h"
+
+#include <iostream>
+
+#include "vk_type.h"
+
+constexpr VkAccessFlags2 WRITE_ACCESS =
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+void render_graph::add_pass(std::string name, std::vector<graph_use> uses,
+                            std::function<void(VkCommandBuffer)> &&record)
+{
+    resolved_pass pass;
+    pass.name = name;
+
+    for (const auto &use : uses)
+        pass.uses.push_back(resolve(use));
+
+    passes.push_back(pass);
+    pass_records.push_back(record);
+}
+
+void render_graph::compile()
+{
+    std::vector<transient_lifetime> lifetimes;
+    std::vector<uint32_t> lifetime_of(allocator->imgs.capacity(), UINT32_MAX);
+
+    for (uint32_t i = 0; i < passes.size(); ++i)
+        for (const auto &use : passes[i].uses) {
+            if (!use.img || !allocator->transient(use.img_id))
+                continue;
+
+            uint32_t &l = lifetime_of[use.id];
+            if (l == UINT32_MAX) {
+                /* nothing survives from the previous frame to read */
+                if (!(use.use.access & WRITE_ACCESS) || !use.use.discard) {
+                    std::cerr << "render graph: transient " << use.use.name.str
+                              << " is read before it is written" << std::endl;
+                    abort();
+                }
+
+                l = lifetimes.size();
+                lifetimes.push_back({use.img_id, i, i});
+            }
+
+            lifetimes[l].last = i;
+        }
+
+    std::vector<uint32_t> placement = allocator->place_transients(lifetimes);
+    std::vector<bool> begun(lifetimes.size(), false);
+
+    for (uint32_t i = 0; i < passes.size(); ++i)
+        for (auto &use : passes[i].uses) {
+            if (!use.img || lifetime_of[use.id] == UINT32_MAX)
+                continue;
+
+            uint32_t l = lifetime_of[use.id];
+            use.alias = placement[l];
+            use.alias_begin = !begun[l];
+            begun[l] = true;
+
+            if (alias_states.size() <= use.alias)
+                alias_states.resize(use.alias + 1);
+        }
+}
+
+void render_graph::import_img(res_name name, VkImageLayout layout,
+                              VkPipelineStageFlags2 stage,
+                              VkAccessFlags2 access)
+{
+    resolved_use use = resolve({name, stage, access, layout, false});
+    resource_state *s = state(true, use.id);
+
+    *s = resource_state{};
+    s->layout = layout;
+    s->write_stage = stage;
+    s->write_access = access & WRITE_ACCESS;
+}
+
+void render_graph::execute(VkCommandBuffer cbuffer)
+{
+    std::vector<planned_pass> plans = plan();
+
+    /* every pass shares the layout, one bind lasts the frame */
+    allocator->bind(cbuffer);
+
+    for (uint32_t i = 0; i < passes.size(); ++i)
+        record_pass(cbuffer, plans[i], i);
+}
+
+void render_graph::execute(VkCommandBuffer cbuffer, worker_pool *workers,
+                           uint32_t family_index)
+{
+    std::vector<planned_pass> plans = plan();
+
+    std::vector<record_job> jobs;
+    for (uint32_t i = 0; i < passes.size(); ++i)
+        jobs.push_back([&, i](VkCommandBuffer secondary) {
+            /* bound state is not inherited by secondaries */
+            allocator->bind(secondary);
+            record_pass(secondary, plans[i], i);
+        });
+
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = nullptr;
+
+    std::vector<VkCommandBuffer> secondaries =
+        workers->record(family_index, &inheritance_info, 0, jobs);
+
+    vkCmdExecuteCommands(cbuffer, secondaries.size(), secondaries.data());
+}
+
+std::vector<render_graph::planned_pass> render_graph::plan()
+{
+    std::vector<planned_pass> plans(passes.size());
+    barrier_count = 0;
+
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        for (const auto &use : passes[i].uses)
+            barrier(use, plans[i].img_barriers, plans[i].buffer_barriers);
+
+        if (!plans[i].img_barriers.empty() ||
+            !plans[i].buffer_barriers.empty())
+            ++barrier_count;
+
+        plans[i].slot = profiler->reserve(passes[i].name);
+    }
+
+    return plans;
+}
+
+void render_graph::record_pass(VkCommandBuffer cbuffer,
+                               const planned_pass &planned, uint32_t pass)
+{
+    /* one batch per pass, nothing when the pass only rereads */
+    if (!planned.img_barriers.empty() || !planned.buffer_barriers.empty()) {
+        VkDependencyInfo dependency_info = {};
+        dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency_info.pNext = nullptr;
+        dependency_info.bufferMemoryBarrierCount =
+            planned.buffer_barriers.size();
+        dependency_info.pBufferMemoryBarriers = planned.buffer_barriers.data();
+        dependency_info.imageMemoryBarrierCount = planned.img_barriers.size();
+        dependency_info.pImageMemoryBarriers = planned.img_barriers.data();
+
+        vkCmdPipelineBarrier2(cbuffer, &dependency_info);
+    }
+
+    profiler->write_begin(cbuffer, planned.slot);
+    pass_records[pass](cbuffer);
+    profiler->write_end(cbuffer, planned.slot);
+}
+
+void render_graph::release_img(VkCommandBuffer cbuffer, res_name name,
+                               VkImageLayout layout, uint32_t src_family_index,
+                               uint32_t dst_family_index)
+{
+    resolved_use use = resolve({name, VK_PIPELINE_STAGE_2_NONE,
+                                VK_ACCESS_2_NONE, layout, false});
+    resource_state *s = state(true, use.id);
+
+    VkImageMemoryBarrier2 img_mem_barrier = {};
+    img_mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    img_mem_barrier.pNext = nullptr;
+    img_mem_barrier.srcStageMask = s->write_stage | s->read_stage;
+    img_mem_barrier.srcAccessMask = s->write_access;
+    /* ignored by a release, covers anything on the same family */
+    img_mem_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    img_mem_barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+    img_mem_barrier.oldLayout = s->layout;
+    img_mem_barrier.newLayout = layout;
+    img_mem_barrier.srcQueueFamilyIndex = src_family_index;
+    img_mem_barrier.dstQueueFamilyIndex = dst_family_index;
+    img_mem_barrier.image = allocator->imgs[use.img_id].img;
+    img_mem_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                        VK_REMAINING_MIP_LEVELS, 0,
+                                        VK_REMAINING_ARRAY_LAYERS};
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &img_mem_barrier;
+
+    vkCmdPipelineBarrier2(cbuffer, &dependency_info);
+    ++barrier_count;
+
+    /* whoever takes it back waits on a semaphore, waiting on all commands
+       chains the next barrier to that wait whatever its stage */
+    *s = resource_state{};
+    s->read_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+}
+
+render_graph::resolved_use render_graph::resolve(const graph_use &use)
+{
+    img_handle img_id = allocator->imgs.find(use.name);
+    if (img_id.valid())
+        return {use, true, img_id.index, img_id, {}};
+
+    buffer_handle buffer_id = allocator->buffers.find(use.name);
+    if (buffer_id.valid())
+        return {use, false, buffer_id.index, {}, buffer_id};
+
+    std::cerr << "render graph: unknown resource " << use.name.str
+              << std::endl;
+    abort();
+}
+
+render_graph::resource_state *render_graph::state(bool img, uint32_t id)
+{
+    std::vector<resource_state> &states = img ? img_states : buffer_states;
+
+    if (states.size() <= id)
+        states.resize(id + 1);
+
+    return &states[id];
+}
+
+void render_graph::barrier(const resolved_use &use,
+                           std::vector<VkImageMemoryBarrier2> &img_barriers,
+                           std::vector<VkBufferMemoryBarrier2> &buffer_barriers)
+{
+    resource_state *s = state(use.img, use.id);
+    const graph_use &u = use.use;
+
+    if (use.alias != UINT32_MAX) {
+        resource_state &a = alias_states[use.alias];
+
+        /* another transient had the memory since, wait for everything it
+           did and start over from UNDEFINED */
+        if (use.alias_begin) {
+            s->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            s->write_stage |= a.write_stage | a.read_stage;
+            s->write_access |= a.write_access;
+            a = resource_state{};
+        }
+
+        a.read_stage |= u.stage;
+        a.write_access |= u.access & WRITE_ACCESS;
+    }
+
+    bool writes = u.access & WRITE_ACCESS;
+    bool transition = use.img && s->layout != u.layout;
+
+    VkPipelineStageFlags2 src_stage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 src_access = VK_ACCESS_2_NONE;
+    bool needed = transition;
+
+    if (writes || transition) {
+        /* write after write, write after read, and a layout transition is a
+           write of its own */
+        src_stage = s->write_stage | s->read_stage;
+        src_access = s->write_access;
+        needed |= src_stage != VK_PIPELINE_STAGE_2_NONE;
+    } else {
+        /* read after write, once per stage and access */
+        bool visible = (s->read_stage & u.stage) == u.stage &&
+                       (s->visible_access & u.access) == u.access;
+        src_stage = s->write_stage;
+        src_access = s->write_access;
+        needed = src_stage != VK_PIPELINE_STAGE_2_NONE && !visible;
+    }
+
+    if (writes) {
+        s->write_stage = u.stage;
+        s->write_access = u.access & WRITE_ACCESS;
+        s->read_stage = VK_PIPELINE_STAGE_2_NONE;
+        s->visible_access = VK_ACCESS_2_NONE;
+    } else if (transition) {
+        s->write_stage = u.stage;
+        s->write_access = VK_ACCESS_2_NONE;
+        s->read_stage = u.stage;
+        s->visible_access = u.access;
+    } else {
+        s->read_stage |= u.stage;
+        if (needed)
+            s->visible_access |= u.access;
+    }
+
+    if (!needed)
+        return;
+
+    if (use.img) {
+        VkImageMemoryBarrier2 img_mem_barrier = {};
+        img_mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        img_mem_barrier.pNext = nullptr;
+        img_mem_barrier.srcStageMask = src_stage;
+        img_mem_barrier.srcAccessMask = src_access;
+        img_mem_barrier.dstStageMask = u.stage;
+        img_mem_barrier.dstAccessMask = u.access;
+        img_mem_barrier.oldLayout =
+            transition && u.discard ? VK_IMAGE_LAYOUT_UNDEFINED : s->layout;
+        img_mem_barrier.newLayout = u.layout;
+        img_mem_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_mem_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_mem_barrier.image = allocator->imgs[use.img_id].img;
+        img_mem_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                            VK_REMAINING_MIP_LEVELS, 0,
+                                            VK_REMAINING_ARRAY_LAYERS};
+        img_barriers.push_back(img_mem_barrier);
+
+        s->layout = u.layout;
+        return;
+    }
+
+    VkBufferMemoryBarrier2 buffer_mem_barrier = {};
+    buffer_mem_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    buffer_mem_barrier.pNext = nullptr;
+    buffer_mem_barrier.srcStageMask = src_stage;
+    buffer_mem_barrier.srcAccessMask = src_access;
+    buffer_mem_barrier.dstStageMask = u.stage;
+    buffer_mem_barrier.dstAccessMask = u.access;
+    buffer_mem_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_mem_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_mem_barrier.buffer = allocator->buffers[use.buffer_id].buffer;
+    buffer_mem_barrier.offset = 0;
+    buffer_mem_barrier.size = VK_WHOLE_SIZE;
+    buffer_barriers.push_back(buffer_mem_barrier);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <volk.h>
+
+#include "vk_comp.h"
+#include "vk_profiler.h"
+#include "vk_workers.h"
+
+/* how a pass touches one comp_allocator image or buffer, layout is ignored
+   for buffers */
+struct graph_use {
+    res_name name;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    /* the pass overwrites everything, previous contents may be dropped */
+    bool discard;
+};
+
+inline graph_use storage_read(res_name name)
+{
+    return {name, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            false};
+}
+
+inline graph_use storage_write(res_name name, bool discard = true)
+{
+    return {name, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            discard};
+}
+
+inline graph_use storage_read_write(res_name name)
+{
+    return {name, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, false};
+}
+
+/* through a sampler, the layout stays GENERAL like every compute image */
+inline graph_use sampled_read(res_name name)
+{
+    return {name, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            false};
+}
+
+struct render_graph {
+public:
+    comp_allocator *allocator;
+    gpu_profiler *profiler;
+
+    void add_pass(std::string name, std::vector<graph_use> uses,
+                  std::function<void(VkCommandBuffer)> &&record);
+
+    /* once after the last add_pass, transients of allocator are placed by
+       the passes using them */
+    void compile();
+
+    /* state of a resource written outside the graph, e.g. by immediate_draw */
+    void import_img(res_name name, VkImageLayout layout,
+                    VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+
+    /* record every pass with the barriers in between */
+    void execute(VkCommandBuffer cbuffer);
+
+    /* same, each pass in its own secondary on the worker pool, executed in
+       order from cbuffer */
+    void execute(VkCommandBuffer cbuffer, worker_pool *workers,
+                 uint32_t family_index);
+
+    /* pass callbacks in order, without barriers, timestamps or the global
+       set bound */
+    inline const std::vector<std::function<void(VkCommandBuffer)>> &
+    records() { return pass_records; };
+
+    /* move an image out of the graph, a release when the families differ,
+       the graph forgets its contents afterwards */
+    void release_img(VkCommandBuffer cbuffer, res_name name,
+                     VkImageLayout layout, uint32_t src_family_index,
+                     uint32_t dst_family_index);
+
+    uint32_t barrier_count = 0;
+
+private:
+    /* last write, and the stages that have seen it or read since */
+    struct resource_state {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 write_stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 write_access = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 read_stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 visible_access = VK_ACCESS_2_NONE;
+    };
+
+    /* id is the registry slot, states are kept per slot. a transient also
+       has the alias slot it shares memory in, and alias_begin on its first
+       use of the frame */
+    struct resolved_use {
+        graph_use use;
+        bool img;
+        uint32_t id;
+        img_handle img_id;
+        buffer_handle buffer_id;
+        uint32_t alias = UINT32_MAX;
+        bool alias_begin = false;
+    };
+
+    struct resolved_pass {
+        std::string name;
+        std::vector<resolved_use> uses;
+    };
+
+    /* barriers and timestamp slot worked out in order before recording */
+    struct planned_pass {
+        std::vector<VkImageMemoryBarrier2> img_barriers;
+        std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+        uint32_t slot;
+    };
+
+    std::vector<resolved_pass> passes;
+    std::vector<std::function<void(VkCommandBuffer)>> pass_records;
+    std::vector<resource_state> img_states;
+    std::vector<resource_state> buffer_states;
+    /* every use of the memory since its current transient began */
+    std::vector<resource_state> alias_states;
+
+    std::vector<planned_pass> plan();
+    void record_pass(VkCommandBuffer cbuffer, const planned_pass &planned,
+                     uint32_t pass);
+
+    resolved_use resolve(const graph_use &use);
+    resource_state *state(bool img, uint32_t id);
+
+    void barrier(const resolved_use &use,
+                 std::vector<VkImageMemoryBarrier2> &img_barriers,
+                 std::vector<VkBufferMemoryBarrier2> &buffer_barriers);
+};
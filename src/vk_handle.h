@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* fnv-1a */
+constexpr uint64_t hash_name(const char *s)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; *s; ++s)
+        hash = (hash ^ (uint8_t)*s) * 1099511628211ull;
+    return hash;
+}
+
+/* name of a comp_allocator resource, the string is kept for error messages
+   only and must outlive the lookup. a literal is hashed while compiling, a
+   name only known at runtime goes through dynamic */
+struct res_name {
+public:
+    template <size_t N>
+    consteval res_name(const char (&name)[N])
+        : hash(hash_name(name)), str(name)
+    {
+    }
+
+    static res_name dynamic(const char *name)
+    {
+        return res_name(hash_name(name), name);
+    }
+
+    uint64_t hash;
+    const char *str;
+
+private:
+    constexpr res_name(uint64_t hash, const char *str) : hash(hash), str(str)
+    {
+    }
+};
+
+/* index into a registry plus the generation of the slot when it was handed
+   out, a handle to a removed resource is caught instead of aliasing the next
+   one in its slot */
+template <typename T> struct handle {
+public:
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    inline bool valid() const { return index != UINT32_MAX; };
+};
+
+/* named resources in stable slots, o(1) lookup by name hash and by handle */
+template <typename T> struct registry {
+public:
+    handle<T> add(res_name name, T item)
+    {
+        if (lookup.count(name.hash)) {
+            std::cerr << "registry: " << name.str
+                      << " already exists or collides" << std::endl;
+            abort();
+        }
+
+        uint32_t index;
+        if (free_slots.empty()) {
+            index = slots.size();
+            slots.push_back({});
+        } else {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        slot &s = slots[index];
+        s.item = item;
+        s.hash = name.hash;
+        s.name = name.str;
+        s.used = true;
+
+        lookup[name.hash] = index;
+        return {index, s.generation};
+    }
+
+    /* an invalid handle when nothing has this name */
+    handle<T> find(res_name name) const
+    {
+        auto it = lookup.find(name.hash);
+        if (it == lookup.end())
+            return {};
+
+        return {it->second, slots[it->second].generation};
+    }
+
+    handle<T> get_handle(res_name name) const
+    {
+        handle<T> h = find(name);
+        if (!h.valid()) {
+            std::cerr << "registry: unknown resource " << name.str
+                      << std::endl;
+            abort();
+        }
+
+        return h;
+    }
+
+    T &get(handle<T> h)
+    {
+        if (h.index >= slots.size() || !slots[h.index].used ||
+            slots[h.index].generation != h.generation) {
+            std::cerr << "registry: stale or invalid handle " << h.index
+                      << std::endl;
+            abort();
+        }
+
+        return slots[h.index].item;
+    }
+
+    inline T &operator[](handle<T> h) { return get(h); };
+
+    /* the slot is reused with a new generation, the caller frees the
+       object itself */
+    void remove(handle<T> h)
+    {
+        get(h);
+
+        slot &s = slots[h.index];
+        lookup.erase(s.hash);
+        s.used = false;
+        ++s.generation;
+        free_slots.push_back(h.index);
+    }
+
+    /* every live resource with the name it was added under */
+    template <typename F> void for_each(F &&f)
+    {
+        for (auto &s : slots)
+            if (s.used)
+                f(s.name, s.item);
+    }
+
+    /* slots ever allocated, an upper bound on handle indices */
+    inline uint32_t capacity() const { return slots.size(); };
+
+private:
+    struct slot {
+        T item;
+        uint32_t generation = 0;
+        uint64_t hash = 0;
+        std::string name;
+        bool used = false;
+    };
+
+    std::vector<slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::unordered_map<uint64_t, uint32_t> lookup;
+};
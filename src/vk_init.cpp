@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include "vk_boiler.h"
+#include "vk_pipeline.h"
 #include "vk_type.h"
 
 void vk_engine::device_init()
@@ -14,6 +15,7 @@ void vk_engine::device_init()
     vkb::InstanceBuilder builder;
     auto inst_ret = builder.set_app_name("vk_engine")
                         .require_api_version(VKB_VK_API_VERSION_1_3)
+                        .set_headless(_headless)
 #ifndef NDEBUG
                         .request_validation_layers(true)
                         .use_default_debug_messenger()
@@ -30,29 +32,54 @@ void vk_engine::device_init()
     _instance = instance.instance;
     _debug_utils_messenger = instance.debug_messenger;
 
-    deletion_queue.push_back([=]() {
+    deletion_queue.push_back([=, this]() {
         vkb::destroy_debug_utils_messenger(_instance, _debug_utils_messenger,
                                            nullptr);
         vkDestroyInstance(_instance, nullptr);
     });
 
     // create surface
-    SDL_Vulkan_CreateSurface(_window, _instance, nullptr, &_surface);
+    if (!_headless) {
+        SDL_Vulkan_CreateSurface(_window, _instance, nullptr, &_surface);
 
-    deletion_queue.push_back(
-        [=]() { vkDestroySurfaceKHR(_instance, _surface, nullptr); });
+        deletion_queue.push_back(
+            [=, this]() { vkDestroySurfaceKHR(_instance, _surface, nullptr); });
+    }
 
-    VkPhysicalDeviceDynamicRenderingFeatures features = {};
-    features.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-    features.pNext = nullptr;
-    features.dynamicRendering = VK_TRUE;
+    VkPhysicalDeviceVulkan13Features features13 = {};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.pNext = nullptr;
+    features13.dynamicRendering = VK_TRUE;
+    features13.synchronization2 = VK_TRUE;
+
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = nullptr;
+    features12.timelineSemaphore = VK_TRUE;
+
+    /* the bindless heap */
+    features12.descriptorIndexing = VK_TRUE;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+
+    /* r8 storage images, the noise volumes and the weather map */
+    VkPhysicalDeviceFeatures features = {};
+    features.shaderStorageImageExtendedFormats = VK_TRUE;
 
     // create physical device
     vkb::PhysicalDeviceSelector selector(instance);
-    auto phys_ret = selector.add_required_extension_features(features)
-                        .set_surface(_surface)
-                        .select();
+    selector.set_required_features(features);
+    selector.set_required_features_13(features13);
+    selector.set_required_features_12(features12);
+
+    if (!_headless)
+        selector.set_surface(_surface);
+
+    auto phys_ret = selector.select();
 
     if (!phys_ret) {
         std::cerr << "failed to find suitable physical device: "
@@ -61,9 +88,41 @@ void vk_engine::device_init()
     }
 
     auto physical_device = phys_ret.value();
+
+    /* cloud.comp adds up its step counts with subgroup arithmetic, core
+       vulkan only guarantees the basic subgroup operations. volk is not
+       loaded yet */
+    auto get_properties2 =
+        (PFN_vkGetPhysicalDeviceProperties2)instance.fp_vkGetInstanceProcAddr(
+            _instance, "vkGetPhysicalDeviceProperties2");
+
+    VkPhysicalDeviceSubgroupProperties subgroup = {};
+    subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    subgroup.pNext = nullptr;
+
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroup;
+    get_properties2(physical_device.physical_device, &properties2);
+
+    if (!(subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) ||
+        !(subgroup.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT)) {
+        std::cerr << "failed to find suitable physical device: "
+                  << physical_device.properties.deviceName
+                  << " has no subgroup arithmetic in compute shaders"
+                  << std::endl;
+        abort();
+    }
+
+    /* real heap budgets for vma instead of its own estimates */
+    _memory.memory_budget = physical_device.enable_extension_if_present(
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
     _physical_device = physical_device.physical_device;
     _min_buffer_alignment =
         physical_device.properties.limits.minUniformBufferOffsetAlignment;
+    _profiler.timestamp_period =
+        physical_device.properties.limits.timestampPeriod;
 
     // create device
     vkb::DeviceBuilder device_builder(physical_device);
@@ -77,8 +136,18 @@ void vk_engine::device_init()
 
     vkb::Device device = dev_ret.value();
     _device = device.device;
+    _profiler.device = _device;
+
+    deletion_queue.push_back(
+        [=, this]() { vkDestroyDevice(_device, nullptr); });
+    deletion_queue.device = _device;
 
-    deletion_queue.push_back([=]() { vkDestroyDevice(_device, nullptr); });
+    pipeline_cache.device = _device;
+    pipeline_cache.init(physical_device.properties, "pipeline_cache.bin");
+
+    /* normally cleared once the pipelines are built, see init */
+    shader_cache.device = _device;
+    deletion_queue.push_back([=]() { shader_cache.clear(); });
 
     auto queue_ret = device.get_queue(vkb::QueueType::graphics);
 
@@ -89,6 +158,45 @@ void vk_engine::device_init()
     }
 
     _queue = queue_ret.value();
+    _fam_index = device.get_queue_index(vkb::QueueType::graphics).value();
+
+    /* a queue family with compute but no graphics. the profiler writes
+       timestamps into its command buffers, a family without them keeps
+       compute on _queue */
+    auto comp_ret = device.get_queue(vkb::QueueType::compute);
+
+    bool comp_timestamps = false;
+    if (comp_ret) {
+        uint32_t index =
+            device.get_queue_index(vkb::QueueType::compute).value();
+        comp_timestamps =
+            physical_device.get_queue_families()[index].timestampValidBits > 0;
+    }
+
+    if (_async_compute && comp_ret && comp_timestamps) {
+        _comp_queue = comp_ret.value();
+        _comp_fam_index =
+            device.get_queue_index(vkb::QueueType::compute).value();
+    } else {
+        _async_compute = false;
+        _comp_queue = _queue;
+        _comp_fam_index = _fam_index;
+    }
+
+    /* a transfer only family, uploads off _queue can come from any thread */
+    auto transfer_ret = device.get_dedicated_queue(vkb::QueueType::transfer);
+
+    if (transfer_ret) {
+        _transfer_queue = transfer_ret.value();
+        _transfer_fam_index =
+            device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+    } else {
+        _transfer_queue = _queue;
+        _transfer_fam_index = _fam_index;
+    }
+
+    std::cout << "async compute "
+              << (_async_compute ? "enabled" : "disabled") << std::endl;
 }
 
 void vk_engine::vma_init()
@@ -98,9 +206,14 @@ void vk_engine::vma_init()
     vma_allocator_info.device = _device;
     vma_allocator_info.instance = _instance;
     vma_allocator_info.pVulkanFunctions = &vma_vulkan_func;
+
+    if (_memory.memory_budget)
+        vma_allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
     vmaCreateAllocator(&vma_allocator_info, &_allocator);
 
-    deletion_queue.push_back([=]() { vmaDestroyAllocator(_allocator); });
+    deletion_queue.push_back([=, this]() { vmaDestroyAllocator(_allocator); });
+    deletion_queue.allocator = _allocator;
 }
 
 void vk_engine::swapchain_init()
@@ -112,7 +225,8 @@ void vk_engine::swapchain_init()
             .set_desired_present_mode(VK_PRESENT_MODE_MAILBOX_KHR)
             .set_desired_extent(_window_extent.width, _window_extent.height)
             .set_desired_format(VkSurfaceFormatKHR{_format, _colorspace})
-            .set_image_usage_flags(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+            .set_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                   VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
             .build()
             .value();
 
@@ -120,14 +234,14 @@ void vk_engine::swapchain_init()
     _swapchain_imgs = vkb_swapchain.get_images().value();
     _swapchain_img_views = vkb_swapchain.get_image_views().value();
 
-    deletion_queue.push_back(
-        [=]() { vkDestroySwapchainKHR(_device, _swapchain, nullptr); });
+    deletion_queue.push(_swapchain);
 
     for (uint32_t i = 0; i < _swapchain_img_views.size(); i++)
-        deletion_queue.push_back([=]() {
-            vkDestroyImageView(_device, _swapchain_img_views[i], nullptr);
-        });
+        deletion_queue.push(_swapchain_img_views[i]);
+}
 
+void vk_engine::target_init()
+{
     _depth_img.format = VK_FORMAT_D32_SFLOAT;
 
     VkImageCreateInfo img_info = vk_boiler::img_create_info(
@@ -140,9 +254,7 @@ void vk_engine::swapchain_init()
     VK_CHECK(vmaCreateImage(_allocator, &img_info, &alloc_info, &_depth_img.img,
                             &_depth_img.allocation, nullptr));
 
-    deletion_queue.push_back([=]() {
-        vmaDestroyImage(_allocator, _depth_img.img, _depth_img.allocation);
-    });
+    deletion_queue.push(_depth_img.img, _depth_img.allocation);
 
     VkImageViewCreateInfo img_view_info = vk_boiler::img_view_create_info(
         VK_IMAGE_ASPECT_DEPTH_BIT, _depth_img.img,
@@ -152,8 +264,7 @@ void vk_engine::swapchain_init()
     VK_CHECK(vkCreateImageView(_device, &img_view_info, nullptr,
                                &_depth_img.img_view));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyImageView(_device, _depth_img.img_view, nullptr); });
+    deletion_queue.push(_depth_img.img_view);
 
     /* create img target for rendering */
     VkExtent3D extent = {};
@@ -165,31 +276,59 @@ void vk_engine::swapchain_init()
                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                0, &_target);
+    deletion_queue.push(_target);
 
     VkSamplerCreateInfo sampler_info = vk_boiler::sampler_create_info();
     VK_CHECK(vkCreateSampler(_device, &sampler_info, nullptr, &_sampler));
-    deletion_queue.push_back(
-        [=]() { vkDestroySampler(_device, _sampler, nullptr); });
+    deletion_queue.push(_sampler);
 }
 
 void vk_engine::command_init()
 {
-    for (uint32_t i = 0; i < FRAME_OVERLAP; ++i) {
+    for (uint32_t i = 0; i < _scheduler.frame_overlap; ++i) {
         VkCommandPoolCreateInfo cpool_info =
             vk_boiler::cpool_create_info(_fam_index);
 
         VK_CHECK(vkCreateCommandPool(_device, &cpool_info, nullptr,
                                      &_frames[i].cpool));
 
-        deletion_queue.push_back([=]() {
-            vkDestroyCommandPool(_device, _frames[i].cpool, nullptr);
-        });
+        deletion_queue.push(_frames[i].cpool);
 
         VkCommandBufferAllocateInfo cbuffer_allocate_info =
             vk_boiler::cbuffer_allocate_info(1, _frames[i].cpool);
 
         VK_CHECK(vkAllocateCommandBuffers(_device, &cbuffer_allocate_info,
                                           &_frames[i].cbuffer));
+
+        VK_CHECK(vkAllocateCommandBuffers(_device, &cbuffer_allocate_info,
+                                          &_frames[i].copy_cbuffer));
+
+        /* compute passes record from the compute family */
+        VkCommandPoolCreateInfo comp_cpool_info =
+            vk_boiler::cpool_create_info(_comp_fam_index);
+
+        VK_CHECK(vkCreateCommandPool(_device, &comp_cpool_info, nullptr,
+                                     &_frames[i].comp_cpool));
+
+        deletion_queue.push(_frames[i].comp_cpool);
+
+        VkCommandBufferAllocateInfo comp_cbuffer_allocate_info =
+            vk_boiler::cbuffer_allocate_info(1, _frames[i].comp_cpool);
+
+        VK_CHECK(vkAllocateCommandBuffers(_device, &comp_cbuffer_allocate_info,
+                                          &_frames[i].comp_cbuffer));
+    }
+
+    if (_record_threads > 0) {
+        std::vector<uint32_t> families = {_fam_index};
+        if (_comp_fam_index != _fam_index)
+            families.push_back(_comp_fam_index);
+
+        _workers.device = _device;
+        _workers.init(_record_threads, _scheduler.frame_overlap, families);
+
+        /* flushed in reverse, the threads stop before their pools go */
+        deletion_queue.push_back([=, this]() { _workers.shutdown(); });
     }
 
     VkCommandPoolCreateInfo cpool_info =
@@ -198,50 +337,82 @@ void vk_engine::command_init()
     VK_CHECK(vkCreateCommandPool(_device, &cpool_info, nullptr,
                                  &_immed_context.cpool));
 
-    deletion_queue.push_back([=]() {
-        vkDestroyCommandPool(_device, _immed_context.cpool, nullptr);
-    });
+    deletion_queue.push(_immed_context.cpool);
 
     VkCommandBufferAllocateInfo cbuffer_allocate_info =
         vk_boiler::cbuffer_allocate_info(1, _immed_context.cpool);
 
     VK_CHECK(vkAllocateCommandBuffers(_device, &cbuffer_allocate_info,
                                       &_immed_context.cbuffer));
+
+    if (!_async_compute)
+        return;
+
+    VkCommandPoolCreateInfo comp_cpool_info =
+        vk_boiler::cpool_create_info(_comp_fam_index);
+
+    VK_CHECK(vkCreateCommandPool(_device, &comp_cpool_info, nullptr,
+                                 &_comp_immed_context.cpool));
+
+    deletion_queue.push(_comp_immed_context.cpool);
+
+    VkCommandBufferAllocateInfo comp_cbuffer_allocate_info =
+        vk_boiler::cbuffer_allocate_info(1, _comp_immed_context.cpool);
+
+    VK_CHECK(vkAllocateCommandBuffers(_device, &comp_cbuffer_allocate_info,
+                                      &_comp_immed_context.cbuffer));
 }
 
 void vk_engine::sync_init()
 {
-    for (uint32_t i = 0; i < FRAME_OVERLAP; ++i) {
-        VkFenceCreateInfo fence_info = vk_boiler::fence_create_info(true);
-
-        VK_CHECK(
-            vkCreateFence(_device, &fence_info, nullptr, &_frames[i].fence));
-
-        deletion_queue.push_back(
-            [=]() { vkDestroyFence(_device, _frames[i].fence, nullptr); });
+    _scheduler.device = _device;
+    _scheduler.init();
 
+    for (uint32_t i = 0; i < _scheduler.frame_overlap; ++i) {
         VkSemaphoreCreateInfo sem_info = vk_boiler::sem_create_info();
 
         VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr,
                                    &_frames[i].sumbit_sem));
 
-        deletion_queue.push_back([=]() {
-            vkDestroySemaphore(_device, _frames[i].sumbit_sem, nullptr);
-        });
+        deletion_queue.push(_frames[i].sumbit_sem);
 
         VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr,
                                    &_frames[i].present_sem));
 
-        deletion_queue.push_back([=]() {
-            vkDestroySemaphore(_device, _frames[i].present_sem, nullptr);
-        });
+        deletion_queue.push(_frames[i].present_sem);
+
+        VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr,
+                                   &_frames[i].comp_sem));
+
+        deletion_queue.push(_frames[i].comp_sem);
+
+        _profiler.init(&_frames[i].queries);
     }
 
+    /* reaches n once frame n has copied _target out */
+    VkSemaphoreTypeCreateInfo sem_type_info =
+        vk_boiler::sem_type_create_info(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+
+    VkSemaphoreCreateInfo target_sem_info = vk_boiler::sem_create_info();
+    target_sem_info.pNext = &sem_type_info;
+
+    VK_CHECK(
+        vkCreateSemaphore(_device, &target_sem_info, nullptr, &_target_sem));
+
+    deletion_queue.push(_target_sem);
+
     VkFenceCreateInfo fence_info = vk_boiler::fence_create_info(false);
 
     VK_CHECK(
         vkCreateFence(_device, &fence_info, nullptr, &_immed_context.fence));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyFence(_device, _immed_context.fence, nullptr); });
+    deletion_queue.push(_immed_context.fence);
+
+    if (!_async_compute)
+        return;
+
+    VK_CHECK(vkCreateFence(_device, &fence_info, nullptr,
+                           &_comp_immed_context.fence));
+
+    deletion_queue.push(_comp_immed_context.fence);
 }
@@ -0,0 +1,116 @@
+#include "vk_memory.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+static std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+
+    return out + "\"";
+}
+
+std::vector<heap_usage> memory_stats::heaps()
+{
+    const VkPhysicalDeviceMemoryProperties *properties;
+    vmaGetMemoryProperties(allocator, &properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+
+    std::vector<heap_usage> result;
+    for (uint32_t i = 0; i < properties->memoryHeapCount; ++i)
+        result.push_back(
+            {i,
+             (properties->memoryHeaps[i].flags &
+              VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+             budgets[i].usage, budgets[i].budget,
+             budgets[i].statistics.blockBytes,
+             budgets[i].statistics.allocationBytes});
+
+    return result;
+}
+
+std::vector<resource_size> memory_stats::resource_sizes()
+{
+    std::vector<resource_size> result;
+    std::unordered_set<VmaAllocation> seen;
+
+    auto add = [&](const std::string &name, const char *kind,
+                   VmaAllocation allocation) {
+        if (allocation == VK_NULL_HANDLE || !seen.insert(allocation).second)
+            return;
+
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, allocation, &info);
+        result.push_back({name, kind, info.size});
+    };
+
+    resources->imgs.for_each([&](const std::string &name, allocated_img &img) {
+        add(name, "img", img.allocation);
+    });
+    resources->buffers.for_each(
+        [&](const std::string &name, allocated_buffer &buffer) {
+            add(name, "buffer", buffer.allocation);
+        });
+
+    /* transient images own no allocation, they share this one */
+    add("transients", "alias", resources->transient_memory);
+
+    std::sort(result.begin(), result.end(),
+              [](const resource_size &a, const resource_size &b) {
+                  return a.bytes > b.bytes;
+              });
+
+    return result;
+}
+
+bool memory_stats::dump_json(const char *filename)
+{
+    std::ofstream f(filename);
+
+    if (!f.is_open()) {
+        std::cerr << "memory: failed to open " << filename << std::endl;
+        return false;
+    }
+
+    f << "{\n  \"memory_budget\": " << (memory_budget ? "true" : "false")
+      << ",\n  \"heaps\": [";
+
+    auto heap_list = heaps();
+    for (size_t i = 0; i < heap_list.size(); ++i) {
+        const heap_usage &h = heap_list[i];
+        f << (i ? "," : "") << "\n    {\"heap\": " << h.heap
+          << ", \"device_local\": " << (h.device_local ? "true" : "false")
+          << ", \"usage\": " << h.usage << ", \"budget\": " << h.budget
+          << ", \"block_bytes\": " << h.block_bytes
+          << ", \"allocation_bytes\": " << h.allocation_bytes << "}";
+    }
+
+    f << "\n  ],\n  \"resources\": [";
+
+    auto sizes = resource_sizes();
+    for (size_t i = 0; i < sizes.size(); ++i)
+        f << (i ? "," : "") << "\n    {\"name\": " << json_string(sizes[i].name)
+          << ", \"kind\": \"" << sizes[i].kind
+          << "\", \"bytes\": " << sizes[i].bytes << "}";
+
+    /* vma names its allocations after ours, see comp_allocator */
+    char *vma_stats;
+    vmaBuildStatsString(allocator, &vma_stats, VK_TRUE);
+    f << "\n  ],\n  \"vma\": " << vma_stats << "\n}" << std::endl;
+    vmaFreeStatsString(allocator, vma_stats);
+
+    f.close();
+
+    std::cout << "memory: " << sizes.size() << " resources written to "
+              << filename << std::endl;
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <volk.h>
+
+#include "vk_mem_alloc.h"
+
+#include "vk_comp.h"
+
+struct heap_usage {
+    uint32_t heap;
+    bool device_local;
+    /* usage and budget of the whole process, from VK_EXT_memory_budget when
+       present and estimated by vma otherwise */
+    VkDeviceSize usage;
+    VkDeviceSize budget;
+    /* vma's share, blocks and the allocations inside them */
+    VkDeviceSize block_bytes;
+    VkDeviceSize allocation_bytes;
+};
+
+struct resource_size {
+    std::string name;
+    const char *kind;
+    VkDeviceSize bytes;
+};
+
+/* where device memory goes, by heap and by comp_allocator name */
+struct memory_stats {
+public:
+    VmaAllocator allocator;
+    comp_allocator *resources;
+    bool memory_budget = false;
+
+    std::vector<heap_usage> heaps();
+
+    /* largest first, resources sharing an allocation such as the uniform
+       views of the ring are counted once under the first name */
+    std::vector<resource_size> resource_sizes();
+
+    /* our heaps and names next to the detailed vmaBuildStatsString map */
+    bool dump_json(const char *filename);
+};
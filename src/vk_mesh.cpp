@@ -1,5 +1,6 @@
 #include "vk_mesh.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -14,7 +15,6 @@
 #include <tiny_gltf.h>
 
 #include "vk_boiler.h"
-#include "vk_cmd.h"
 #include "vk_engine.h"
 #include "vk_type.h"
 
@@ -298,13 +298,11 @@ void vk_engine::load_meshes()
 
     _meshes.insert(_meshes.end(), example.begin(), example.end());
 
-    create_buffer(_nodes.size() * pad_uniform_buffer_size(sizeof(render_mat)),
-                  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                  &_render_mat_buffer);
+    buffer_handle id =
+        _comp_allocator.create_uniform(sizeof(render_mat), "render_mat");
 
     VkDescriptorBufferInfo descriptor_buffer_info = {};
-    descriptor_buffer_info.buffer = _render_mat_buffer.buffer;
+    descriptor_buffer_info.buffer = _comp_allocator.buffers[id].buffer;
     descriptor_buffer_info.offset = 0;
     descriptor_buffer_info.range = sizeof(render_mat);
 
@@ -317,92 +315,38 @@ void vk_engine::load_meshes()
 
 void vk_engine::upload_meshes(mesh *meshes, size_t size)
 {
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+        vertex_count += meshes[i].vertices.size();
+        index_count += meshes[i].indices.size();
+    }
+
+    /* room for as much again before compaction */
+    if (_geometry.vertex_buffer.buffer == VK_NULL_HANDLE) {
+        _geometry.device = _device;
+        _geometry.allocator = _allocator;
+        _geometry.uploads = &_uploader;
+        _geometry.init(std::max(GEOMETRY_MIN_VERTICES, vertex_count * 2),
+                       std::max(GEOMETRY_MIN_INDICES, index_count * 2));
+    }
+
     for (uint32_t i = 0; i < size; ++i) {
         mesh *mesh = &meshes[i];
-        allocated_buffer staging_buffer;
-
-        /* create vertex buffer */
-        create_buffer(mesh->vertices.size() * sizeof(vertex),
-                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                      &staging_buffer);
-
-        void *data;
-        vmaMapMemory(_allocator, staging_buffer.allocation, &data);
-        std::memcpy(data, mesh->vertices.data(),
-                    mesh->vertices.size() * sizeof(vertex));
-        vmaUnmapMemory(_allocator, staging_buffer.allocation);
-
-        create_buffer(mesh->vertices.size() * sizeof(vertex),
-                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                      0, &mesh->vertex_buffer);
-
-        deletion_queue.push_back([=]() {
-            vmaDestroyBuffer(_allocator, _meshes[i].vertex_buffer.buffer,
-                             _meshes[i].vertex_buffer.allocation);
-        });
-
-        immediate_draw(
-            [=](VkCommandBuffer cbuffer) {
-                VkBufferCopy region = {};
-                region.size = mesh->vertices.size() * sizeof(vertex);
-                vkCmdCopyBuffer(cbuffer, staging_buffer.buffer,
-                                mesh->vertex_buffer.buffer, 1, &region);
-            },
-            _queue);
-
-        vmaDestroyBuffer(_allocator, staging_buffer.buffer,
-                         staging_buffer.allocation);
-
-        /* create index buffer */
-        create_buffer(mesh->indices.size() * sizeof(uint16_t),
-                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                      &staging_buffer);
-
-        vmaMapMemory(_allocator, staging_buffer.allocation, &data);
-        std::memcpy(data, mesh->indices.data(),
-                    mesh->indices.size() * sizeof(uint16_t));
-        vmaUnmapMemory(_allocator, staging_buffer.allocation);
-
-        create_buffer(mesh->indices.size() * sizeof(uint16_t),
-                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-                          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                      0, &mesh->index_buffer);
-
-        immediate_draw(
-            [=](VkCommandBuffer cbuffer) {
-                VkBufferCopy region = {};
-                region.size = mesh->indices.size() * sizeof(uint16_t);
-                vkCmdCopyBuffer(cbuffer, staging_buffer.buffer,
-                                mesh->index_buffer.buffer, 1, &region);
-            },
-            _queue);
-
-        vmaDestroyBuffer(_allocator, staging_buffer.buffer,
-                         staging_buffer.allocation);
+        mesh->geometry = _geometry.add(mesh->vertices, mesh->indices);
+        mesh->ticket = _geometry.ticket;
     }
+
+    /* one submission for every mesh, drawn as they finish */
+    _uploader.submit();
 }
 
 void vk_engine::upload_textures(mesh *meshes, size_t size)
 {
     for (uint32_t i = 0; i < size; ++i) {
         mesh *mesh = &meshes[i];
-        allocated_buffer staging_buffer;
 
         if (mesh->texture.size() != 0) {
-            create_buffer(mesh->texture.size() * sizeof(unsigned char),
-                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                          VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                          &staging_buffer);
-
-            void *data;
-            vmaMapMemory(_allocator, staging_buffer.allocation, &data);
-            std::memcpy(data, mesh->texture.data(),
-                        mesh->texture.size() * sizeof(unsigned char));
-            vmaUnmapMemory(_allocator, staging_buffer.allocation);
-
             VkExtent3D extent = {};
             extent.width = mesh->texture_buffer.extent.width;
             extent.height = mesh->texture_buffer.extent.height;
@@ -412,50 +356,23 @@ void vk_engine::upload_textures(mesh *meshes, size_t size)
                 mesh->texture_buffer.format, extent, VK_IMAGE_ASPECT_COLOR_BIT,
                 VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0,
                 &mesh->texture_buffer);
-
-            immediate_draw(
-                [=](VkCommandBuffer cbuffer) {
-                    vk_cmd::vk_img_layout_transition(
-                        cbuffer, mesh->texture_buffer.img,
-                        VK_IMAGE_LAYOUT_UNDEFINED,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _fam_index);
-
-                    VkBufferImageCopy region =
-                        vk_boiler::buffer_img_copy(extent);
-
-                    vkCmdCopyBufferToImage(cbuffer, staging_buffer.buffer,
-                                           mesh->texture_buffer.img,
-                                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                           1, &region);
-
-                    vk_cmd::vk_img_layout_transition(
-                        cbuffer, mesh->texture_buffer.img,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _fam_index);
-                },
-                _queue);
-
-            vmaDestroyBuffer(_allocator, staging_buffer.buffer,
-                             staging_buffer.allocation);
-
-            VkDescriptorSetAllocateInfo descriptor_set_allocate_info =
-                vk_boiler::descriptor_set_allocate_info(_descriptor_pool,
-                                                        &_texture_layout);
-
-            VK_CHECK(vkAllocateDescriptorSets(
-                _device, &descriptor_set_allocate_info, &mesh->texture_set));
-
-            VkDescriptorImageInfo descriptor_img_info = {};
-            descriptor_img_info.sampler = _sampler;
-            descriptor_img_info.imageView = mesh->texture_buffer.img_view;
-            descriptor_img_info.imageLayout =
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            VkWriteDescriptorSet write_set = vk_boiler::write_descriptor_set(
-                &descriptor_img_info, mesh->texture_set, 0,
-                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-            vkUpdateDescriptorSets(_device, 1, &write_set, 0, nullptr);
+            deletion_queue.push(mesh->texture_buffer);
+
+            mesh->ticket = std::max(
+                mesh->ticket,
+                _uploader.upload_img(
+                    mesh->texture.data(),
+                    mesh->texture.size() * sizeof(unsigned char),
+                    mesh->texture_buffer, extent,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+            /* not sampled before the ticket is done */
+            mesh->texture_buffer.sampled_index =
+                _comp_allocator.heap.add_sampled_img(
+                    mesh->texture_buffer.img_view, _sampler,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
         }
     }
+
+    _uploader.submit();
 }
@@ -8,6 +8,7 @@
 #include <glm/vec3.hpp>
 
 #include "vk_type.h"
+#include "vk_upload.h"
 
 struct vertex_input_description {
     std::vector<VkVertexInputBindingDescription> bindings;
@@ -24,14 +25,16 @@ struct vertex {
 
 struct mesh {
     std::vector<vertex> vertices;
-    allocated_buffer vertex_buffer;
-
     std::vector<uint16_t> indices;
-    allocated_buffer index_buffer;
+
+    /* range of the shared geometry_arena */
+    uint32_t geometry;
 
     std::vector<unsigned char> texture;
     allocated_img texture_buffer;
-    VkDescriptorSet texture_set;
+
+    /* drawn once the buffers and texture are done */
+    upload_ticket ticket = 0;
 };
 
 struct material {
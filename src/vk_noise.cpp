@@ -0,0 +1,127 @@
+#include "vk_noise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+/* gaussian energy of every texel from the set ones around it, wrapping at
+   the edges. kept up to date as ones come and go */
+struct energy_field {
+public:
+    energy_field(uint32_t size) : size(size), energy(size * size, 0.f)
+    {
+        /* sigma 1.5, the usual choice for void and cluster */
+        kernel.resize(size * size);
+        for (uint32_t y = 0; y < size; ++y)
+            for (uint32_t x = 0; x < size; ++x) {
+                float dx = std::min(x, size - x);
+                float dy = std::min(y, size - y);
+                kernel[y * size + x] =
+                    std::exp(-(dx * dx + dy * dy) / (2.f * 1.5f * 1.5f));
+            }
+    }
+
+    uint32_t size;
+    std::vector<float> energy;
+
+    void add(uint32_t i, float sign)
+    {
+        uint32_t x0 = i % size;
+        uint32_t y0 = i / size;
+
+        for (uint32_t y = 0; y < size; ++y)
+            for (uint32_t x = 0; x < size; ++x) {
+                uint32_t dx = (x + size - x0) % size;
+                uint32_t dy = (y + size - y0) % size;
+                energy[y * size + x] += sign * kernel[dy * size + dx];
+            }
+    }
+
+    /* the one with the most energy is the tightest cluster, the zero with
+       the least the largest void */
+    uint32_t extreme(const std::vector<uint8_t> &ones, uint8_t value,
+                     bool most)
+    {
+        uint32_t best = UINT32_MAX;
+        for (uint32_t i = 0; i < energy.size(); ++i) {
+            if (ones[i] != value)
+                continue;
+
+            if (best == UINT32_MAX || (most ? energy[i] > energy[best]
+                                            : energy[i] < energy[best]))
+                best = i;
+        }
+
+        return best;
+    }
+
+private:
+    std::vector<float> kernel;
+};
+
+std::vector<uint8_t> blue_noise(uint32_t size)
+{
+    uint32_t count = size * size;
+    std::vector<uint8_t> ones(count, 0);
+    std::vector<uint32_t> rank(count, 0);
+
+    /* a tenth of the texels at random */
+    std::mt19937 rng(1);
+    uint32_t initial = count / 10;
+    for (uint32_t n = 0; n < initial;) {
+        uint32_t i = rng() % count;
+        if (!ones[i]) {
+            ones[i] = 1;
+            ++n;
+        }
+    }
+
+    energy_field field(size);
+    for (uint32_t i = 0; i < count; ++i)
+        if (ones[i])
+            field.add(i, 1.f);
+
+    /* spread them out, move the tightest cluster into the largest void
+       until it would land where it came from */
+    for (;;) {
+        uint32_t cluster = field.extreme(ones, 1, true);
+        ones[cluster] = 0;
+        field.add(cluster, -1.f);
+
+        uint32_t gap = field.extreme(ones, 0, false);
+        ones[gap] = 1;
+        field.add(gap, 1.f);
+
+        if (gap == cluster)
+            break;
+    }
+
+    std::vector<uint8_t> prototype = ones;
+    std::vector<float> prototype_energy = field.energy;
+
+    /* ranks below initial, taking the tightest cluster away each time */
+    for (uint32_t r = initial; r-- > 0;) {
+        uint32_t cluster = field.extreme(ones, 1, true);
+        ones[cluster] = 0;
+        field.add(cluster, -1.f);
+        rank[cluster] = r;
+    }
+
+    /* the rest, filling the largest void each time. past half the texels
+       this is also the tightest cluster of the zeros */
+    ones = prototype;
+    field.energy = prototype_energy;
+
+    for (uint32_t r = initial; r < count; ++r) {
+        uint32_t gap = field.extreme(ones, 0, false);
+        ones[gap] = 1;
+        field.add(gap, 1.f);
+        rank[gap] = r;
+    }
+
+    std::vector<uint8_t> texels(count);
+    for (uint32_t i = 0; i < count; ++i)
+        texels[i] = rank[i] * 256 / count;
+
+    return texels;
+}
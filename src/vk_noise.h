@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/* size x size texels of tiling blue noise, each of 0..255 about equally
+   often. void and cluster with a fixed seed, the same texture every run */
+std::vector<uint8_t> blue_noise(uint32_t size);
@@ -1,5 +1,11 @@
 #include "vk_pipeline.h"
 
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <volk.h>
 
 #include "vk_boiler.h"
@@ -19,8 +25,7 @@ PipelineBuilder::build_layout(VkDevice device,
     VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
                                     &pipeline_layout));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyPipelineLayout(device, pipeline_layout, nullptr); });
+    deletion_queue.push(pipeline_layout);
 
     return pipeline_layout;
 }
@@ -83,36 +88,153 @@ VkPipeline PipelineBuilder::build_gfx(VkDevice device, VkFormat *format,
     graphics_pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     // graphics_pipeline_info.basePipelineIndex = ;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+    auto begin = std::chrono::steady_clock::now();
+
+    VK_CHECK(vkCreateGraphicsPipelines(device, pipeline_cache.cache, 1,
                                        &graphics_pipeline_info, nullptr,
                                        &pipeline));
 
-    deletion_queue.push_back(
-        [=]() { vkDestroyPipeline(device, pipeline, nullptr); });
+    pipeline_cache.add_time(std::chrono::duration<float, std::milli>(
+                                std::chrono::steady_clock::now() - begin)
+                                .count());
+
+    deletion_queue.push(pipeline);
 
     return pipeline;
 }
 
-void PipelineBuilder::build_comp(
-    VkDevice device, std::vector<VkPushConstantRange> &push_constants, cs *cs)
+void PipelineBuilder::build_comp(VkDevice device, cs *cs,
+                                 const VkSpecializationInfo *specialization)
 {
-    std::vector<VkDescriptorSetLayout> layouts = {cs->layout};
-    cs->pipeline_layout = build_layout(device, layouts, push_constants);
-
     VkComputePipelineCreateInfo comp_pipeline_info = {};
     comp_pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     comp_pipeline_info.pNext = nullptr;
     // comp_pipeline_info.flags = ;
     comp_pipeline_info.stage = _shader_stage_infos[0];
+    comp_pipeline_info.stage.pSpecializationInfo = specialization;
     comp_pipeline_info.layout = cs->pipeline_layout;
     comp_pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     // comp_pipeline_info.basePipelineIndex = ;
 
-    VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1,
+    auto begin = std::chrono::steady_clock::now();
+
+    VK_CHECK(vkCreateComputePipelines(device, pipeline_cache.cache, 1,
                                       &comp_pipeline_info, nullptr,
                                       &cs->pipeline));
 
-    VkPipeline pipeline = cs->pipeline;
-    deletion_queue.push_back(
-        [=]() { vkDestroyPipeline(device, pipeline, nullptr); });
+    pipeline_cache.add_time(std::chrono::duration<float, std::milli>(
+                                std::chrono::steady_clock::now() - begin)
+                                .count());
+
+    deletion_queue.push(cs->pipeline);
+}
+
+void pipeline_cache::init(const VkPhysicalDeviceProperties &properties,
+                          std::string file)
+{
+    filename = file;
+
+    expected = {};
+    expected.magic = MAGIC;
+    expected.vendor_id = properties.vendorID;
+    expected.device_id = properties.deviceID;
+    expected.driver_version = properties.driverVersion;
+    std::memcpy(expected.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::vector<char> data;
+    std::ifstream f(filename, std::ios::binary);
+
+    if (f.is_open()) {
+        file_header header = {};
+        f.read((char *)&header, sizeof(file_header));
+
+        /* everything but the size has to match */
+        if (f && std::memcmp(&header, &expected,
+                             offsetof(file_header, data_size)) == 0) {
+            /* a truncated or corrupt file must not size the allocation */
+            std::streamoff body = f.tellg();
+            f.seekg(0, std::ios::end);
+            std::streamoff remaining = f.tellg() - body;
+            f.seekg(body);
+
+            if (remaining >= 0 && header.data_size == (uint64_t)remaining) {
+                data.resize(header.data_size);
+                f.read(data.data(), data.size());
+            }
+
+            if (!f || data.empty()) {
+                data.clear();
+                std::cout << "pipeline cache: " << filename
+                          << " is truncated or corrupt" << std::endl;
+            }
+        } else
+            std::cout << "pipeline cache: " << filename
+                      << " is from another device or driver" << std::endl;
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.pNext = nullptr;
+    cache_info.initialDataSize = data.size();
+    cache_info.pInitialData = data.data();
+
+    VK_CHECK(vkCreatePipelineCache(device, &cache_info, nullptr, &cache));
+    deletion_queue.push(cache);
+
+    warm = !data.empty();
+}
+
+bool pipeline_cache::save()
+{
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, nullptr));
+
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, data.data()));
+
+    file_header header = expected;
+    header.data_size = size;
+
+    /* a crash while writing leaves the old file alone */
+    std::string tmp = filename + ".tmp";
+    std::ofstream f(tmp, std::ios::binary);
+
+    if (!f.is_open()) {
+        std::cerr << "pipeline cache: failed to open " << tmp << std::endl;
+        return false;
+    }
+
+    f.write((const char *)&header, sizeof(file_header));
+    f.write(data.data(), size);
+    f.close();
+
+    std::error_code error;
+    if (f.fail()) {
+        std::cerr << "pipeline cache: failed to write " << tmp << std::endl;
+        std::filesystem::remove(tmp, error);
+        return false;
+    }
+
+    std::filesystem::rename(tmp, filename, error);
+
+    if (error) {
+        std::cerr << "pipeline cache: failed to replace " << filename << ": "
+                  << error.message() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void pipeline_cache::add_time(float ms)
+{
+    create_ms += ms;
+    ++create_count;
+}
+
+void pipeline_cache::log()
+{
+    std::cout << "pipeline cache: " << (warm ? "warm" : "cold") << ", "
+              << create_count << " pipelines in " << create_ms << " ms"
+              << std::endl;
 }
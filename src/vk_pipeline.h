@@ -1,8 +1,51 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include <volk.h>
 
+/* one VkPipelineCache for every pipeline, kept on disk between runs */
+struct pipeline_cache {
+public:
+    VkDevice device;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+
+    /* loads filename unless it was written by another device or driver */
+    void init(const VkPhysicalDeviceProperties &properties,
+              std::string filename);
+
+    /* into a temporary file renamed over filename, call before the cache is
+       destroyed */
+    bool save();
+
+    /* time spent creating pipelines, logged once they are all built */
+    void add_time(float ms);
+    void log();
+
+    bool warm = false;
+
+private:
+    /* ours, ahead of the driver's data, whose own header has no driver
+       version */
+    struct file_header {
+        uint32_t magic;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+    };
+
+    static constexpr uint32_t MAGIC = 0x43504b56;
+
+    file_header expected;
+    std::string filename;
+    float create_ms = 0.f;
+    uint32_t create_count = 0;
+};
+
+inline pipeline_cache pipeline_cache;
+
 class PipelineBuilder
 {
 public:
@@ -24,7 +67,9 @@ public:
                          VkFormat depth_format,
                          VkPipelineLayout pipeline_layout);
 
-    void build_comp(VkDevice device,
-                    std::vector<VkPushConstantRange> &push_constants,
-                    struct cs *cs);
+    /* on cs->pipeline_layout, shared by every compute shader. build again
+       with other specialization constants for another variant, each build
+       overwrites cs->pipeline */
+    void build_comp(VkDevice device, struct cs *cs,
+                    const VkSpecializationInfo *specialization = nullptr);
 };
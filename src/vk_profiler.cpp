@@ -0,0 +1,137 @@
+#include "vk_profiler.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "vk_type.h"
+
+void gpu_profiler::init(query_frame *frame)
+{
+    VkQueryPoolCreateInfo query_pool_info = {};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.pNext = nullptr;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = MAX_QUERIES;
+
+    VK_CHECK(
+        vkCreateQueryPool(device, &query_pool_info, nullptr, &frame->pool));
+
+    frame->frame_number = 0;
+
+    deletion_queue.push(frame->pool);
+}
+
+void gpu_profiler::begin_frame(VkCommandBuffer cbuffer, query_frame *frame,
+                               uint64_t frame_number)
+{
+    collect(frame);
+
+    vkCmdResetQueryPool(cbuffer, frame->pool, 0, MAX_QUERIES);
+    frame->names.clear();
+    frame->frame_number = frame_number;
+    current = frame;
+}
+
+void gpu_profiler::begin(VkCommandBuffer cbuffer, const std::string &name)
+{
+    open = reserve(name);
+    write_begin(cbuffer, open);
+}
+
+void gpu_profiler::end(VkCommandBuffer cbuffer)
+{
+    write_end(cbuffer, open);
+    open = MAX_QUERIES;
+}
+
+uint32_t gpu_profiler::reserve(const std::string &name)
+{
+    if (current->names.size() * 2 >= MAX_QUERIES)
+        return MAX_QUERIES;
+
+    current->names.push_back(name);
+    return (current->names.size() - 1) * 2;
+}
+
+void gpu_profiler::write_begin(VkCommandBuffer cbuffer, uint32_t slot)
+{
+    if (slot >= MAX_QUERIES)
+        return;
+
+    vkCmdWriteTimestamp(cbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        current->pool, slot);
+}
+
+void gpu_profiler::write_end(VkCommandBuffer cbuffer, uint32_t slot)
+{
+    if (slot >= MAX_QUERIES)
+        return;
+
+    vkCmdWriteTimestamp(cbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        current->pool, slot + 1);
+}
+
+void gpu_profiler::collect(query_frame *frame)
+{
+    uint32_t count = frame->names.size() * 2;
+    if (count == 0)
+        return;
+
+    /* the frame has already retired, so never wait here */
+    std::vector<uint64_t> timestamps(count);
+    VkResult ret = vkGetQueryPoolResults(
+        device, frame->pool, 0, count, count * sizeof(uint64_t),
+        timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (ret != VK_SUCCESS)
+        return;
+
+    results.clear();
+    for (uint32_t i = 0; i < frame->names.size(); ++i) {
+        profiler_result result;
+        result.name = frame->names[i];
+        result.ms = (timestamps[i * 2 + 1] - timestamps[i * 2]) *
+                    timestamp_period / 1000000.f;
+        results.push_back(result);
+    }
+
+    results_frame = frame->frame_number;
+
+    if (history.size() >= history_size)
+        history.erase(history.begin());
+    history.push_back({results_frame, results});
+
+    frame->names.clear();
+}
+
+float gpu_profiler::total_ms() { return total_ms(results); }
+
+float gpu_profiler::total_ms(const std::vector<profiler_result> &frame_results)
+{
+    float ms = 0.f;
+    for (const auto &result : frame_results)
+        ms += result.ms;
+    return ms;
+}
+
+bool gpu_profiler::export_csv(const char *filename)
+{
+    std::ofstream f(filename);
+
+    if (!f.is_open()) {
+        std::cerr << "profiler: failed to open " << filename << std::endl;
+        return false;
+    }
+
+    f << "frame,pass,ms" << std::endl;
+    for (const auto &[frame_number, frame_results] : history)
+        for (const auto &result : frame_results)
+            f << frame_number << "," << result.name << "," << result.ms
+              << std::endl;
+
+    f.close();
+
+    std::cout << "profiler: " << history.size() << " frames written to "
+              << filename << std::endl;
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <volk.h>
+
+constexpr uint32_t MAX_QUERIES = 64;
+
+/* per frame timestamp queries, two per named pass */
+struct query_frame {
+    VkQueryPool pool;
+    std::vector<std::string> names;
+    uint64_t frame_number;
+};
+
+struct profiler_result {
+    std::string name;
+    float ms;
+};
+
+struct gpu_profiler {
+public:
+    VkDevice device;
+    float timestamp_period;
+
+    /* results of the latest retired frame */
+    std::vector<profiler_result> results;
+    uint64_t results_frame = 0;
+
+    void init(query_frame *frame);
+
+    /* read back the retired frame in this slot and reset its queries, call
+       only after the frame has retired */
+    void begin_frame(VkCommandBuffer cbuffer, query_frame *frame,
+                     uint64_t frame_number);
+
+    void begin(VkCommandBuffer cbuffer, const std::string &name);
+    void end(VkCommandBuffer cbuffer);
+
+    /* take a pass slot up front so secondary command buffers can write its
+       timestamps from any thread, MAX_QUERIES when the frame is full */
+    uint32_t reserve(const std::string &name);
+    void write_begin(VkCommandBuffer cbuffer, uint32_t slot);
+    void write_end(VkCommandBuffer cbuffer, uint32_t slot);
+
+    /* read back a retired frame without starting a new one */
+    void collect(query_frame *frame);
+
+    float total_ms();
+    float total_ms(const std::vector<profiler_result> &frame_results);
+    bool export_csv(const char *filename);
+
+    uint32_t history_size = 4096;
+    std::vector<std::pair<uint64_t, std::vector<profiler_result>>> history;
+
+private:
+    query_frame *current = nullptr;
+    uint32_t open = MAX_QUERIES;
+};
@@ -0,0 +1,76 @@
+#include "vk_shader.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "vk_type.h"
+
+/* fnv-1a like hash_name, over the words of the spir-v */
+static uint64_t hash_code(const uint32_t *code, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size / sizeof(uint32_t); ++i)
+        hash = (hash ^ code[i]) * 1099511628211ull;
+    return hash;
+}
+
+VkShaderModule shader_cache::get(const char *name)
+{
+    if (dir.empty()) {
+        for (const embedded_shader *s = embedded_shaders; s->name; ++s)
+            if (std::strcmp(s->name, name) == 0)
+                return create((const uint32_t *)s->code, s->size);
+
+        std::cerr << "shader: " << name << " not embedded" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    std::string filename = dir + "/" + name + ".spv";
+    std::ifstream f(filename, std::ios::ate | std::ios::binary);
+
+    if (!f.is_open()) {
+        std::cerr << "shader: " << filename << " not exist" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    size_t size = f.tellg();
+    std::vector<uint32_t> buffer(size / sizeof(uint32_t));
+
+    f.seekg(0);
+    f.read((char *)buffer.data(), size);
+    f.close();
+
+    return create(buffer.data(), buffer.size() * sizeof(uint32_t));
+}
+
+void shader_cache::clear()
+{
+    for (auto &[hash, module] : modules)
+        vkDestroyShaderModule(device, module, nullptr);
+
+    modules.clear();
+}
+
+VkShaderModule shader_cache::create(const uint32_t *code, size_t size)
+{
+    uint64_t hash = hash_code(code, size);
+
+    auto it = modules.find(hash);
+    if (it != modules.end())
+        return it->second;
+
+    VkShaderModuleCreateInfo shader_module_info = {};
+    shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_module_info.pNext = nullptr;
+    shader_module_info.codeSize = size;
+    shader_module_info.pCode = code;
+
+    VkShaderModule module;
+    VK_CHECK(
+        vkCreateShaderModule(device, &shader_module_info, nullptr, &module));
+
+    modules.emplace(hash, module);
+    return module;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <volk.h>
+
+/* shaders/<name>.spv compiled into the executable, see shaders/embed.cmake */
+struct embedded_shader {
+    /* the source's file name, e.g. "cloud.comp" */
+    const char *name;
+    const unsigned char *code;
+    size_t size;
+};
+
+/* generated, ends with a {nullptr, nullptr, 0} entry */
+extern const embedded_shader embedded_shaders[];
+
+/* VkShaderModules keyed by a hash of their spir-v, a shader used by several
+   pipelines is created once. modules are only needed while pipelines are
+   built, clear() them afterwards */
+struct shader_cache {
+public:
+    VkDevice device;
+
+    /* read <name>.spv from there instead of the embedded copy, for editing
+       shaders without relinking. empty by default */
+    std::string dir;
+
+    /* VK_NULL_HANDLE when there is no such shader */
+    VkShaderModule get(const char *name);
+
+    /* destroys every module, pipelines built from them stay valid */
+    void clear();
+
+private:
+    std::unordered_map<uint64_t, VkShaderModule> modules;
+
+    VkShaderModule create(const uint32_t *code, size_t size);
+};
+
+inline shader_cache shader_cache;
@@ -0,0 +1,137 @@
+#include "vk_type.h"
+
+#include <algorithm>
+
+void deletion_queue::push(allocated_buffer &buffer)
+{
+    buffer.deletion_slot = push(buffer.buffer, buffer.allocation);
+}
+
+void deletion_queue::push(allocated_img &img)
+{
+    /* flushed in reverse, the view goes before its image */
+    img.deletion_slot = push(img.img, img.allocation);
+    push(img.img_view);
+}
+
+void deletion_queue::push_back(std::function<void()> &&f)
+{
+    callbacks.push_back(std::move(f));
+    entries.push_back(
+        {vk_object::callback, callbacks.size() - 1, VK_NULL_HANDLE, 0});
+}
+
+void deletion_queue::retire_slot(uint32_t slot, uint64_t frame)
+{
+    entry e = entries[slot];
+    e.frame = frame;
+    retired.push_back(e);
+
+    entries[slot].type = vk_object::none;
+}
+
+void deletion_queue::retire(const allocated_buffer &buffer, uint64_t frame)
+{
+    if (buffer.deletion_slot != UINT32_MAX)
+        retire_slot(buffer.deletion_slot, frame);
+    else
+        retire(buffer.buffer, frame, buffer.allocation);
+}
+
+void deletion_queue::retire(const allocated_img &img, uint64_t frame)
+{
+    if (img.deletion_slot != UINT32_MAX) {
+        retire_slot(img.deletion_slot + 1, frame);
+        retire_slot(img.deletion_slot, frame);
+    } else {
+        retire(img.img_view, frame);
+        retire(img.img, frame, img.allocation);
+    }
+}
+
+void deletion_queue::collect(uint64_t completed_frame)
+{
+    /* keeps the order objects were retired in */
+    auto live = std::stable_partition(
+        retired.begin(), retired.end(),
+        [=](const entry &e) { return e.frame <= completed_frame; });
+
+    for (auto e = retired.begin(); e != live; ++e)
+        destroy(*e);
+
+    retired.erase(retired.begin(), live);
+}
+
+void deletion_queue::flush()
+{
+    /* retired objects were created after everything they depend on */
+    for (const auto &e : retired)
+        destroy(e);
+
+    for (auto e = entries.rbegin(); e != entries.rend(); ++e)
+        destroy(*e);
+
+    retired.clear();
+    entries.clear();
+    callbacks.clear();
+}
+
+void deletion_queue::destroy(const entry &e)
+{
+    switch (e.type) {
+    case vk_object::buffer:
+        vmaDestroyBuffer(allocator, (VkBuffer)e.object, e.allocation);
+        break;
+    case vk_object::img:
+        vmaDestroyImage(allocator, (VkImage)e.object, e.allocation);
+        break;
+    case vk_object::img_view:
+        vkDestroyImageView(device, (VkImageView)e.object, nullptr);
+        break;
+    case vk_object::sampler:
+        vkDestroySampler(device, (VkSampler)e.object, nullptr);
+        break;
+    case vk_object::shader_module:
+        vkDestroyShaderModule(device, (VkShaderModule)e.object, nullptr);
+        break;
+    case vk_object::pipeline:
+        vkDestroyPipeline(device, (VkPipeline)e.object, nullptr);
+        break;
+    case vk_object::pipeline_layout:
+        vkDestroyPipelineLayout(device, (VkPipelineLayout)e.object, nullptr);
+        break;
+    case vk_object::pipeline_cache:
+        vkDestroyPipelineCache(device, (VkPipelineCache)e.object, nullptr);
+        break;
+    case vk_object::descriptor_pool:
+        vkDestroyDescriptorPool(device, (VkDescriptorPool)e.object, nullptr);
+        break;
+    case vk_object::descriptor_set_layout:
+        vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout)e.object,
+                                     nullptr);
+        break;
+    case vk_object::cpool:
+        vkDestroyCommandPool(device, (VkCommandPool)e.object, nullptr);
+        break;
+    case vk_object::semaphore:
+        vkDestroySemaphore(device, (VkSemaphore)e.object, nullptr);
+        break;
+    case vk_object::fence:
+        vkDestroyFence(device, (VkFence)e.object, nullptr);
+        break;
+    case vk_object::query_pool:
+        vkDestroyQueryPool(device, (VkQueryPool)e.object, nullptr);
+        break;
+    case vk_object::swapchain:
+        vkDestroySwapchainKHR(device, (VkSwapchainKHR)e.object, nullptr);
+        break;
+    case vk_object::allocation:
+        vmaFreeMemory(allocator, (VmaAllocation)e.object);
+        break;
+    case vk_object::callback:
+        callbacks[e.object]();
+        break;
+    case vk_object::none:
+        break;
+    }
+}
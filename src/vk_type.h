@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <functional>
 #include <vector>
 #include <volk.h>
@@ -22,10 +23,15 @@
 #define VK_CHECK(x) x
 #endif
 
+/* *_index are slots in the bindless heap, UINT32_MAX when not in it.
+   deletion_slot is the entry deletion_queue.push made, the image's with its
+   view in the next one */
 struct allocated_buffer {
     VkBuffer buffer;
     VmaAllocation allocation;
     VkDeviceSize size;
+    uint32_t storage_index = UINT32_MAX;
+    uint32_t deletion_slot = UINT32_MAX;
 };
 
 struct allocated_img {
@@ -33,23 +39,155 @@ struct allocated_img {
     VkExtent3D extent;
     VkFormat format;
     VmaAllocation allocation;
+    /* over every mip level */
     VkImageView img_view;
+    uint32_t storage_index = UINT32_MAX;
+    uint32_t sampled_index = UINT32_MAX;
+    uint32_t mip_levels = 1;
+    uint32_t deletion_slot = UINT32_MAX;
 };
 
+enum class vk_object : uint8_t {
+    buffer,
+    img,
+    img_view,
+    sampler,
+    shader_module,
+    pipeline,
+    pipeline_layout,
+    pipeline_cache,
+    descriptor_pool,
+    descriptor_set_layout,
+    cpool,
+    semaphore,
+    fence,
+    query_pool,
+    swapchain,
+    /* memory without a resource of its own, e.g. what transients alias */
+    allocation,
+    callback,
+    /* a pushed entry retire took over */
+    none,
+};
+
+template <typename T> struct vk_object_of;
+
+#define VK_OBJECT_OF(T, object)                                                \
+    template <> struct vk_object_of<T> {                                       \
+        static constexpr vk_object type = vk_object::object;                   \
+    }
+
+VK_OBJECT_OF(VkBuffer, buffer);
+VK_OBJECT_OF(VkImage, img);
+VK_OBJECT_OF(VkImageView, img_view);
+VK_OBJECT_OF(VkSampler, sampler);
+VK_OBJECT_OF(VkShaderModule, shader_module);
+VK_OBJECT_OF(VkPipeline, pipeline);
+VK_OBJECT_OF(VkPipelineLayout, pipeline_layout);
+VK_OBJECT_OF(VkPipelineCache, pipeline_cache);
+VK_OBJECT_OF(VkDescriptorPool, descriptor_pool);
+VK_OBJECT_OF(VkDescriptorSetLayout, descriptor_set_layout);
+VK_OBJECT_OF(VkCommandPool, cpool);
+VK_OBJECT_OF(VkSemaphore, semaphore);
+VK_OBJECT_OF(VkFence, fence);
+VK_OBJECT_OF(VkQueryPool, query_pool);
+VK_OBJECT_OF(VkSwapchainKHR, swapchain);
+VK_OBJECT_OF(VmaAllocation, allocation);
+
+#undef VK_OBJECT_OF
+
+/* vulkan objects are plain records in two growing arrays, no allocation per
+   object once capacity is reached. push keeps an object until flush at
+   cleanup, retire frees it once the frame that last used it has retired.
+   push returns the slot of the entry, retire_slot hands that entry to
+   retire and leaves a none in its place, no search and no shifting */
 struct deletion_queue {
 public:
-    void push_back(std::function<void()> &&f) { fs.push_back(f); }
+    VkDevice device = VK_NULL_HANDLE;
+    VmaAllocator allocator = VK_NULL_HANDLE;
 
-    void flush()
+    template <typename T>
+    uint32_t push(T object, VmaAllocation allocation = VK_NULL_HANDLE)
     {
-        for (auto f = fs.rbegin(); f != fs.rend(); f++)
-            (*f)();
+        entries.push_back({vk_object_of<T>::type, (uint64_t)object,
+                           allocation, 0});
+        return entries.size() - 1;
+    }
 
-        fs.clear();
-    };
+    /* record the slot in deletion_slot */
+    void push(allocated_buffer &buffer);
+    void push(allocated_img &img);
+
+    /* teardown that is not a single vulkan object, the device, instance,
+       window and the like */
+    void push_back(std::function<void()> &&f);
+
+    /* objects that were never pushed */
+    template <typename T>
+    void retire(T object, uint64_t frame,
+                VmaAllocation allocation = VK_NULL_HANDLE)
+    {
+        retired.push_back({vk_object_of<T>::type, (uint64_t)object,
+                           allocation, frame});
+    }
+
+    void retire_slot(uint32_t slot, uint64_t frame);
+
+    /* through deletion_slot when pushed */
+    void retire(const allocated_buffer &buffer, uint64_t frame);
+    void retire(const allocated_img &img, uint64_t frame);
+
+    /* destroy everything retired in completed_frame or earlier */
+    void collect(uint64_t completed_frame);
+
+    /* the device must be idle */
+    void flush();
+
+    inline size_t pending() { return retired.size(); };
 
 private:
-    std::vector<std::function<void()>> fs;
+    struct entry {
+        vk_object type;
+        uint64_t object;
+        VmaAllocation allocation;
+        uint64_t frame;
+    };
+
+    std::vector<entry> entries;
+    std::vector<entry> retired;
+    std::vector<std::function<void()>> callbacks;
+
+    void destroy(const entry &e);
 };
 
 inline deletion_queue deletion_queue;
+
+/* one writer and one reader thread, neither ever blocks, the reader always
+   sees the newest complete write */
+template <typename T> struct triple_buffer {
+public:
+    void write(const T &value)
+    {
+        buffers[back] = value;
+
+        /* publish back, keep writing into the slot it replaces */
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & SLOT;
+    }
+
+    const T &read()
+    {
+        if (middle.load(std::memory_order_relaxed) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & SLOT;
+
+        return buffers[front];
+    }
+
+private:
+    static constexpr uint32_t SLOT = 3;
+    static constexpr uint32_t FRESH = 4;
+
+    T buffers[3];
+    std::atomic<uint32_t> middle{1};
+    uint32_t back = 0;
+    uint32_t front = 2;
+};
@@ -0,0 +1,321 @@
+#include "vk_upload.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "vk_boiler.h"
+#include "vk_cmd.h"
+
+void uploader::init()
+{
+    VkCommandPoolCreateInfo cpool_info =
+        vk_boiler::cpool_create_info(family_index);
+    /* command buffers are recycled one by one as their batch retires */
+    cpool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    VK_CHECK(vkCreateCommandPool(device, &cpool_info, nullptr, &cpool));
+    deletion_queue.push(cpool);
+
+    VkSemaphoreTypeCreateInfo sem_type_info =
+        vk_boiler::sem_type_create_info(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+
+    VkSemaphoreCreateInfo sem_info = vk_boiler::sem_create_info();
+    sem_info.pNext = &sem_type_info;
+
+    VK_CHECK(vkCreateSemaphore(device, &sem_info, nullptr, &timeline));
+    deletion_queue.push(timeline);
+
+    VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = STAGING_RING_SIZE;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo vma_allocation_info = {};
+    vma_allocation_info.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+        VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    vma_allocation_info.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VmaAllocationInfo allocation_info = {};
+    VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &vma_allocation_info,
+                             &ring.buffer, &ring.allocation,
+                             &allocation_info));
+    vmaSetAllocationName(allocator, ring.allocation, "staging ring");
+
+    ring.size = buffer_info.size;
+    ring_data = (char *)allocation_info.pMappedData;
+
+    deletion_queue.push(ring);
+}
+
+upload_ticket uploader::upload_buffer(const void *data, VkDeviceSize size,
+                                      const allocated_buffer &dst,
+                                      VkDeviceSize dst_offset)
+{
+    VkMemoryPropertyFlags properties;
+    vmaGetAllocationMemoryProperties(allocator, dst.allocation, &properties);
+
+    if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VK_CHECK(vmaCopyMemoryToAllocation(allocator, data, dst.allocation,
+                                           dst_offset, size));
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* at most half the ring at a time, a large buffer streams through it */
+    for (VkDeviceSize copied = 0; copied < size;) {
+        VkDeviceSize chunk = std::min(size - copied, STAGING_RING_SIZE / 2);
+        VkDeviceSize offset = reserve(chunk, 16);
+
+        std::memcpy(ring_data + offset, (const char *)data + copied, chunk);
+        vmaFlushAllocation(allocator, ring.allocation, offset, chunk);
+
+        VkCommandBuffer c = cbuffer();
+
+        VkBufferCopy region = {};
+        region.srcOffset = offset;
+        region.dstOffset = dst_offset + copied;
+        region.size = chunk;
+        vkCmdCopyBuffer(c, ring.buffer, dst.buffer, 1, &region);
+
+        if (family_index != dst_family_index) {
+            vk_cmd::vk_buffer_barrier(c, dst.buffer, region.dstOffset, chunk,
+                                      family_index, dst_family_index);
+            acquires.push_back({recording.ticket, dst.buffer, region.dstOffset,
+                                chunk, VK_NULL_HANDLE,
+                                VK_IMAGE_LAYOUT_UNDEFINED});
+        }
+
+        copied += chunk;
+    }
+
+    return recording.ticket;
+}
+
+upload_ticket uploader::upload_img(const void *data, VkDeviceSize size,
+                                   const allocated_img &dst,
+                                   VkExtent3D extent, VkImageLayout layout)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkDeviceSize offset = reserve(size, 16);
+
+    std::memcpy(ring_data + offset, data, size);
+    vmaFlushAllocation(allocator, ring.allocation, offset, size);
+
+    VkCommandBuffer c = cbuffer();
+
+    vk_cmd::vk_img_layout_transition(c, dst.img, VK_IMAGE_LAYOUT_UNDEFINED,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     family_index);
+
+    VkBufferImageCopy region = vk_boiler::buffer_img_copy(extent);
+    region.bufferOffset = offset;
+    vkCmdCopyBufferToImage(c, ring.buffer, dst.img,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    /* the acquire repeats the layout change on the other side */
+    vk_cmd::vk_img_ownership_transfer(c, dst.img,
+                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                      layout, family_index, dst_family_index);
+
+    if (family_index != dst_family_index)
+        acquires.push_back(
+            {recording.ticket, VK_NULL_HANDLE, 0, 0, dst.img, layout});
+
+    return recording.ticket;
+}
+
+upload_ticket uploader::submit()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return submit_locked();
+}
+
+void uploader::acquire(VkCommandBuffer cbuffer)
+{
+    /* a loader waiting for ring space holds the lock, try next frame */
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    retire();
+    uint64_t value = completed();
+
+    auto waiting = std::stable_partition(
+        acquires.begin(), acquires.end(),
+        [=](const pending_acquire &a) { return a.ticket <= value; });
+
+    for (auto a = acquires.begin(); a != waiting; ++a)
+        if (a->img != VK_NULL_HANDLE)
+            vk_cmd::vk_img_ownership_transfer(
+                cbuffer, a->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                a->layout, family_index, dst_family_index);
+        else
+            vk_cmd::vk_buffer_barrier(cbuffer, a->buffer, a->offset, a->size,
+                                      family_index, dst_family_index);
+
+    acquires.erase(acquires.begin(), waiting);
+
+    /* anything drawn after this in cbuffer or later may use them */
+    acquired.store(value, std::memory_order_release);
+}
+
+void uploader::wait(upload_ticket ticket)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    wait_locked(ticket);
+}
+
+uint64_t uploader::completed()
+{
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &value));
+    return value;
+}
+
+void uploader::retire()
+{
+    uint64_t value = completed();
+
+    /* batches retire in submission order */
+    auto live = in_flight.begin();
+    for (; live != in_flight.end() && live->ticket <= value; ++live) {
+        tail = live->ring_end;
+        free_cbuffers.push_back(live->cbuffer);
+    }
+
+    in_flight.erase(in_flight.begin(), live);
+}
+
+VkCommandBuffer uploader::cbuffer()
+{
+    if (recording.cbuffer != VK_NULL_HANDLE)
+        return recording.cbuffer;
+
+    if (free_cbuffers.empty()) {
+        VkCommandBufferAllocateInfo cbuffer_allocate_info =
+            vk_boiler::cbuffer_allocate_info(1, cpool);
+
+        VkCommandBuffer c;
+        VK_CHECK(vkAllocateCommandBuffers(device, &cbuffer_allocate_info, &c));
+        free_cbuffers.push_back(c);
+    }
+
+    recording.cbuffer = free_cbuffers.back();
+    free_cbuffers.pop_back();
+
+    /* resets it implicitly */
+    VkCommandBufferBeginInfo cbuffer_begin_info =
+        vk_boiler::cbuffer_begin_info();
+    VK_CHECK(vkBeginCommandBuffer(recording.cbuffer, &cbuffer_begin_info));
+
+    return recording.cbuffer;
+}
+
+VkDeviceSize uploader::reserve(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (size > STAGING_RING_SIZE) {
+        std::cerr << "uploader: " << size << " bytes do not fit the ring"
+                  << std::endl;
+        abort();
+    }
+
+    VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+
+    /* a copy never wraps around the end */
+    if (offset % STAGING_RING_SIZE + size > STAGING_RING_SIZE)
+        offset = (offset / STAGING_RING_SIZE + 1) * STAGING_RING_SIZE;
+
+    while (offset + size - tail > STAGING_RING_SIZE) {
+        retire();
+
+        if (in_flight.empty() && recording.cbuffer == VK_NULL_HANDLE) {
+            /* nothing left in the ring */
+            tail = offset;
+            break;
+        }
+
+        if (offset + size - tail <= STAGING_RING_SIZE)
+            break;
+
+        /* the oldest copies hold the space, ours too when nothing else is
+           in flight */
+        if (in_flight.empty())
+            submit_locked();
+
+        wait_locked(in_flight.front().ticket);
+    }
+
+    head = offset + size;
+    return offset % STAGING_RING_SIZE;
+}
+
+upload_ticket uploader::submit_locked()
+{
+    if (recording.cbuffer == VK_NULL_HANDLE)
+        return recording.ticket - 1;
+
+    /* the acquires do this when the families differ */
+    if (family_index == dst_family_index) {
+        VkMemoryBarrier2 mem_barrier = {};
+        mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        mem_barrier.pNext = nullptr;
+        mem_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+        mem_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        mem_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        mem_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+
+        VkDependencyInfo dependency_info = {};
+        dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency_info.pNext = nullptr;
+        dependency_info.memoryBarrierCount = 1;
+        dependency_info.pMemoryBarriers = &mem_barrier;
+
+        vkCmdPipelineBarrier2(recording.cbuffer, &dependency_info);
+    }
+
+    VK_CHECK(vkEndCommandBuffer(recording.cbuffer));
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext = nullptr;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &recording.ticket;
+
+    VkSubmitInfo submit_info = vk_boiler::submit_info(
+        &recording.cbuffer, nullptr, &timeline, nullptr);
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = 0;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    recording.ring_end = head;
+    in_flight.push_back(recording);
+
+    upload_ticket ticket = recording.ticket;
+    recording = {VK_NULL_HANDLE, ticket + 1, 0};
+
+    return ticket;
+}
+
+void uploader::wait_locked(upload_ticket ticket)
+{
+    if (ticket == recording.ticket) {
+        /* nothing was recorded under it */
+        if (recording.cbuffer == VK_NULL_HANDLE)
+            return;
+
+        submit_locked();
+    }
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.pNext = nullptr;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline;
+    wait_info.pValues = &ticket;
+
+    VK_CHECK(vkWaitSemaphores(device, &wait_info, UINT64_MAX));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <volk.h>
+
+#include "vk_mem_alloc.h"
+
+#include "vk_type.h"
+
+constexpr VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+
+/* value the uploader's timeline reaches once the copies are done, 0 is
+   always done */
+typedef uint64_t upload_ticket;
+
+/* copies into device buffers and images through one persistently mapped
+   staging ring, batched into a single submission on the transfer queue.
+   nothing blocks unless the ring is full of copies still in flight */
+struct uploader {
+public:
+    VkDevice device;
+    VmaAllocator allocator;
+    VkQueue queue;
+    uint32_t family_index;
+    /* the family drawing with the uploads, ownership moves there in acquire
+       when it is not family_index */
+    uint32_t dst_family_index;
+
+    void init();
+
+    /* dst allocated with HOST_ACCESS_ALLOW_TRANSFER_INSTEAD lands in host
+       visible device local memory where there is some, it is written in
+       place and the ticket is done right away */
+    upload_ticket upload_buffer(const void *data, VkDeviceSize size,
+                                const allocated_buffer &dst,
+                                VkDeviceSize dst_offset = 0);
+
+    /* one mip, one layer, in layout once done */
+    upload_ticket upload_img(const void *data, VkDeviceSize size,
+                             const allocated_img &dst, VkExtent3D extent,
+                             VkImageLayout layout);
+
+    /* send every copy since the last submit, returns their ticket */
+    upload_ticket submit();
+
+    /* record the acquire of every finished upload into cbuffer on
+       dst_family_index, outside any rendering scope */
+    void acquire(VkCommandBuffer cbuffer);
+
+    /* finished and acquired, safe to draw with from any thread */
+    inline bool done(upload_ticket ticket)
+    {
+        return ticket <= acquired.load(std::memory_order_acquire);
+    };
+
+    /* blocks until the copies are done, not acquired */
+    void wait(upload_ticket ticket);
+
+private:
+    struct batch {
+        VkCommandBuffer cbuffer;
+        upload_ticket ticket;
+        /* ring position once its copies are retired */
+        VkDeviceSize ring_end;
+    };
+
+    /* a buffer range, or a whole image when img is set */
+    struct pending_acquire {
+        upload_ticket ticket;
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        VkImage img;
+        VkImageLayout layout;
+    };
+
+    std::mutex mutex;
+
+    VkCommandPool cpool;
+    std::vector<VkCommandBuffer> free_cbuffers;
+    VkSemaphore timeline;
+
+    allocated_buffer ring;
+    char *ring_data;
+    /* positions grow forever, the offset in the ring is modulo its size */
+    VkDeviceSize head = 0;
+    VkDeviceSize tail = 0;
+
+    std::vector<batch> in_flight;
+    batch recording = {VK_NULL_HANDLE, 1, 0};
+
+    std::vector<pending_acquire> acquires;
+    std::atomic<upload_ticket> acquired{0};
+
+    uint64_t completed();
+    void retire();
+    VkCommandBuffer cbuffer();
+    VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment);
+    upload_ticket submit_locked();
+    void wait_locked(upload_ticket ticket);
+};
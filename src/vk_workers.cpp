@@ -0,0 +1,152 @@
+#include "vk_workers.h"
+
+#include <algorithm>
+
+#include "vk_boiler.h"
+#include "vk_type.h"
+
+void worker_pool::init(uint32_t thread_count, uint32_t frame_overlap,
+                       std::vector<uint32_t> family_indices)
+{
+    families = family_indices;
+    cpools.resize(thread_count);
+
+    for (uint32_t t = 0; t < thread_count; ++t) {
+        cpools[t].resize(frame_overlap);
+
+        for (uint32_t f = 0; f < frame_overlap; ++f)
+            for (uint32_t family : families) {
+                VkCommandPoolCreateInfo cpool_info =
+                    vk_boiler::cpool_create_info(family);
+                /* reset as a whole once the frame retires */
+                cpool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+                worker_cpool pool = {};
+                VK_CHECK(vkCreateCommandPool(device, &cpool_info, nullptr,
+                                             &pool.cpool));
+                cpools[t][f].push_back(pool);
+                deletion_queue.push(pool.cpool);
+            }
+    }
+
+    for (uint32_t t = 0; t < thread_count; ++t)
+        threads.emplace_back([this, t]() { work(t); });
+}
+
+void worker_pool::begin_frame(uint32_t frame)
+{
+    frame_index = frame;
+
+    for (auto &thread_cpools : cpools)
+        for (auto &pool : thread_cpools[frame_index]) {
+            VK_CHECK(vkResetCommandPool(device, pool.cpool, 0));
+            pool.used = 0;
+        }
+}
+
+std::vector<VkCommandBuffer>
+worker_pool::record(uint32_t family_index,
+                    const VkCommandBufferInheritanceInfo *inheritance_info,
+                    VkCommandBufferUsageFlags flags,
+                    const std::vector<record_job> &jobs)
+{
+    std::vector<VkCommandBuffer> cbuffers(jobs.size());
+
+    if (jobs.empty())
+        return cbuffers;
+
+    auto b = std::make_shared<batch>();
+    b->family = std::find(families.begin(), families.end(), family_index) -
+                families.begin();
+    b->inheritance_info = inheritance_info;
+    b->flags = flags;
+    b->jobs = &jobs;
+    b->cbuffers = &cbuffers;
+    b->remaining = jobs.size();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    current = b;
+    ++generation;
+    work_cv.notify_all();
+
+    done_cv.wait(lock, [&]() { return b->remaining.load() == 0; });
+    current.reset();
+
+    return cbuffers;
+}
+
+void worker_pool::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    work_cv.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    threads.clear();
+}
+
+void worker_pool::work(uint32_t thread)
+{
+    uint64_t seen = 0;
+
+    while (true) {
+        std::shared_ptr<batch> b;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [&]() { return stop || generation != seen; });
+
+            if (stop)
+                return;
+
+            seen = generation;
+            b = current;
+        }
+
+        if (!b)
+            continue;
+
+        /* a late thread finds next past the end and goes back to sleep */
+        uint32_t i;
+        while ((i = b->next.fetch_add(1)) < b->jobs->size()) {
+            VkCommandBuffer cbuffer = acquire(thread, b->family);
+
+            VkCommandBufferBeginInfo cbuffer_begin_info =
+                vk_boiler::cbuffer_begin_info();
+            cbuffer_begin_info.flags |= b->flags;
+            cbuffer_begin_info.pInheritanceInfo = b->inheritance_info;
+
+            VK_CHECK(vkBeginCommandBuffer(cbuffer, &cbuffer_begin_info));
+            (*b->jobs)[i](cbuffer);
+            VK_CHECK(vkEndCommandBuffer(cbuffer));
+
+            (*b->cbuffers)[i] = cbuffer;
+
+            if (b->remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done_cv.notify_all();
+            }
+        }
+    }
+}
+
+VkCommandBuffer worker_pool::acquire(uint32_t thread, uint32_t family)
+{
+    worker_cpool &pool = cpools[thread][frame_index][family];
+
+    if (pool.used == pool.cbuffers.size()) {
+        VkCommandBufferAllocateInfo cbuffer_allocate_info =
+            vk_boiler::cbuffer_allocate_info(1, pool.cpool);
+        cbuffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        VkCommandBuffer cbuffer;
+        VK_CHECK(vkAllocateCommandBuffers(device, &cbuffer_allocate_info,
+                                          &cbuffer));
+        pool.cbuffers.push_back(cbuffer);
+    }
+
+    return pool.cbuffers[pool.used++];
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <volk.h>
+
+typedef std::function<void(VkCommandBuffer)> record_job;
+
+/* secondary command buffers of one thread, frame slot and queue family */
+struct worker_cpool {
+    VkCommandPool cpool;
+    std::vector<VkCommandBuffer> cbuffers;
+    uint32_t used;
+};
+
+/* records jobs into secondary command buffers on a fixed set of threads,
+   every thread owns a command pool per frame in flight and queue family */
+struct worker_pool {
+public:
+    VkDevice device;
+
+    void init(uint32_t thread_count, uint32_t frame_overlap,
+              std::vector<uint32_t> family_indices);
+
+    /* the frame in this slot has retired, recycle its command buffers */
+    void begin_frame(uint32_t frame_index);
+
+    /* record every job in parallel and return the secondaries in job order,
+       blocks until all are ended */
+    std::vector<VkCommandBuffer>
+    record(uint32_t family_index,
+           const VkCommandBufferInheritanceInfo *inheritance_info,
+           VkCommandBufferUsageFlags flags,
+           const std::vector<record_job> &jobs);
+
+    /* joins the threads, the pools themselves are on deletion_queue and must
+       outlive this */
+    void shutdown();
+
+    inline uint32_t size() { return threads.size(); };
+
+private:
+    struct batch {
+        uint32_t family;
+        const VkCommandBufferInheritanceInfo *inheritance_info;
+        VkCommandBufferUsageFlags flags;
+        const std::vector<record_job> *jobs;
+        std::vector<VkCommandBuffer> *cbuffers;
+        std::atomic<uint32_t> next{0};
+        std::atomic<uint32_t> remaining{0};
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<uint32_t> families;
+    /* [thread][frame][family] */
+    std::vector<std::vector<std::vector<worker_cpool>>> cpools;
+    uint32_t frame_index = 0;
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::shared_ptr<batch> current;
+    uint64_t generation = 0;
+    bool stop = false;
+
+    void work(uint32_t thread);
+    VkCommandBuffer acquire(uint32_t thread, uint32_t family);
+};